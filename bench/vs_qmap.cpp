@@ -1,3 +1,5 @@
+#include <stdio.h>
+#include <stddef.h>
 #include <string.h>
 #include <assert.h>
 #include <limits>
@@ -232,6 +234,9 @@ static void bench_read()
 #endif
 	}
 	print_stats_md("random access");
+#ifdef HUGE_PAGES
+	printf("huge page backed: %llu of %llu bytes\n", (unsigned long long)btree_memory_hugepage(btree), (unsigned long long)btree_memory_total(btree));
+#endif
 
 	for(i = 0; i < RUNS; i++) {
 		gettimeofday(&start, NULL);
@@ -789,7 +794,23 @@ static void bench_iterate()
 
 int main()
 {
+#if defined(HUGE_PAGES) || defined(INT_KEYS)
+	btree_params_t params = {};
+	params.order = BTREE_ORDER;
+	params.element_size = sizeof(entry_t);
+#ifdef INT_KEYS
+	params.key_type = BTREE_KEY_INT32;
+	params.key_offset = offsetof(entry_t, key);
+#else
+	params.cmp = (btree_cmp_t)cmp_entry;
+#endif
+#ifdef HUGE_PAGES
+	params.options = BTREE_OPT_HUGE_PAGES;
+#endif
+	btree = btree_new_ex(&params);
+#else
 	btree = btree_new(BTREE_ORDER, sizeof(entry_t), (btree_cmp_t)cmp_entry, 0);
+#endif
 
 	mkseq(ELEMS);
 	
@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/time.h>
+#include <btree/memory.h>
+
+#include "helper.h"
+
+/* wide elements with and without BTREE_OPT_PERMUTED_LEAVES. build e.g. with
+ * gcc -O3 -DELEMENT_BYTES=256 -DLEAF_ORDER=255 wide_elements.c helper.c -lbtree */
+#define BTREE_ORDER 15
+#ifndef LEAF_ORDER
+#define LEAF_ORDER 255
+#endif
+#ifndef ELEMENT_BYTES
+#define ELEMENT_BYTES 256
+#endif
+#define RUNS 5
+#define ELEMS 200000
+
+typedef struct {
+	int key;
+	int value;
+	char payload[ELEMENT_BYTES - 2 * sizeof(int)];
+} entry_t;
+
+static uint64_t msec_plain[RUNS];
+static uint64_t msec_permuted[RUNS];
+static int values[ELEMS];
+
+static int cmp_entry(
+		btree_t *tree,
+		const entry_t *a,
+		const entry_t *b,
+		void *group)
+{
+	if(a->key < b->key)
+		return -1;
+	else if(a->key > b->key)
+		return 1;
+	else
+		return 0;
+}
+
+static int cmp_int(const void *a_, const void *b_)
+{
+	const uint64_t *a = (const uint64_t*)a_;
+	const uint64_t *b = (const uint64_t*)b_;
+	if(*a < *b)
+		return -1;
+	else if(*a > *b)
+		return 1;
+	else
+		return 0;
+}
+
+static void print_row(const char *item, uint64_t *samples)
+{
+	uint64_t sum = 0;
+	size_t i;
+
+	qsort(samples, RUNS, sizeof(uint64_t), cmp_int);
+	for(i = 0; i < RUNS; i++)
+		sum += samples[i];
+	printf("| **%s** | %llu | %llu | %llu | %llu |\n", item, (unsigned long long)samples[0], (unsigned long long)samples[RUNS - 1], (unsigned long long)(sum / RUNS), (unsigned long long)samples[RUNS / 2]);
+}
+
+static void print_stats_md(const char *bench)
+{
+	printf("### %s\n", bench);
+	printf("| item | min | max | avg | median |\n");
+	printf("|----------|----:|----:|----:|----:|\n");
+	print_row("btree", msec_plain);
+	print_row("btree permuted", msec_permuted);
+	printf("\n");
+}
+
+static btree_t *new_tree(int options)
+{
+	btree_params_t params;
+
+	memset(&params, 0, sizeof(params));
+	params.order = BTREE_ORDER;
+	params.leaf_order = LEAF_ORDER;
+	params.element_size = sizeof(entry_t);
+	params.cmp = (btree_cmp_t)cmp_entry;
+	params.options = options;
+	return btree_new_ex(&params);
+}
+
+static uint64_t msec_since(const struct timeval *start)
+{
+	struct timeval end;
+
+	gettimeofday(&end, NULL);
+	return (end.tv_sec - start->tv_sec) * 1000 + (end.tv_usec - start->tv_usec) / 1000;
+}
+
+int main()
+{
+	btree_t *btree[2];
+	uint64_t *msec[2] = { msec_plain, msec_permuted };
+	struct timeval start;
+	entry_t entry;
+	entry_t *pentry;
+	size_t i;
+	size_t k;
+	int t;
+
+	btree[0] = new_tree(0);
+	btree[1] = new_tree(BTREE_OPT_PERMUTED_LEAVES);
+	if(btree[0] == NULL || btree[1] == NULL) {
+		perror("btree_new_ex");
+		return 1;
+	}
+	memset(&entry, 0, sizeof(entry));
+	mkseq(ELEMS);
+
+	printf("elements: %d bytes, order %d, leaf order %d\n\n", (int)sizeof(entry_t), BTREE_ORDER, LEAF_ORDER);
+
+	for(i = 0; i < RUNS; i++)
+		for(t = 0; t < 2; t++) {
+			btree_clear(btree[t]);
+			gettimeofday(&start, NULL);
+			for(k = 0; k < ELEMS; k++) {
+				entry.key = sequence_rnd[k];
+				entry.value = k;
+				btree_insert(btree[t], &entry);
+			}
+			msec[t][i] = msec_since(&start);
+		}
+	print_stats_md("random insert elements");
+
+	for(i = 0; i < RUNS; i++)
+		for(t = 0; t < 2; t++) {
+			gettimeofday(&start, NULL);
+			for(k = 0; k < ELEMS; k++) {
+				entry.key = sequence_rnd[(k * 7919) % ELEMS];
+				pentry = (entry_t*)btree_get(btree[t], &entry);
+				values[k] = pentry->value;
+			}
+			msec[t][i] = msec_since(&start);
+			consume(values);
+		}
+	print_stats_md("random access");
+
+	for(i = 0; i < RUNS; i++)
+		for(t = 0; t < 2; t++) {
+			gettimeofday(&start, NULL);
+			for(k = 0; k < ELEMS; k++) {
+				entry.key = sequence_rnd[(k * 7919) % ELEMS];
+				btree_remove(btree[t], &entry);
+			}
+			msec[t][i] = msec_since(&start);
+			for(k = 0; k < ELEMS; k++) { /* refill for the next run */
+				entry.key = sequence_rnd[k];
+				entry.value = k;
+				btree_insert(btree[t], &entry);
+			}
+		}
+	print_stats_md("random remove elements");
+
+	btree_destroy(btree[0]);
+	btree_destroy(btree[1]);
+	return 0;
+}
@@ -15,6 +15,17 @@ enum {
 	BTREE_OPT_ALLOW_INDEX = 0x00000004, /* allow using an index for insertions/replacements (i.e. insert_at and put_at methods) while still using a compare function. however, a check will be performed whether the insertion/replacement is allowed at that position */
 	BTREE_OPT_USE_SUBELEMENTS = 0x00000008, /* each element contains an array of subelements. requires size and subelement hooks */
 	BTREE_OPT_INSERT_LOWER = 0x00000010, /* required BTREE_OPT_MULTI_KEY; insert new elements at lower end of the group */
+	BTREE_OPT_ARENA = 0x00000020, /* carve nodes from large chunks. nodes are never freed individually; clearing/destroying a tree without release hook just drops the chunks */
+	BTREE_OPT_SHARED_POOL = 0x00000040, /* take nodes from a process-wide pool with per-thread caches shared by all trees with the same node size. not available with a custom allocator or BTREE_OPT_ARENA */
+	BTREE_OPT_HUGE_PAGES = 0x00000080, /* implies BTREE_OPT_ARENA; chunks are mmap()ed regions aligned to and advised for transparent huge pages (falls back to regular pages and finally to the allocator). chunk sizes are rounded up to 2 MiB */
+	BTREE_OPT_STRING_KEYS = 0x00000100, /* keys are byte strings ordered like memcmp() (shorter first on a common prefix), see btree_params_t.string_key. every node keeps the common prefix of its keys once. leaves keep the remaining bytes of every key in a slotted page of 'leaf_bytes' (see btree_params_t.leaf_bytes) and are split, merged and balanced by those bytes, so that they hold the more keys the longer their common prefix; interior nodes keep the next bytes of every key. comparisons within a node memcmp() those bytes and only touch the elements for keys longer than the node keeps */
+	BTREE_OPT_KEY_COLUMN = 0x00000200, /* every node keeps a dense copy of the keys of its elements (see btree_params_t.key_size/key_offset), searches only touch those. both arguments of 'cmp' point to keys: the first one to the key of a stored element, the second one is either a key handed to a lookup function or the key within an element handed to btree_insert()/btree_put()/btree_remove() */
+	BTREE_OPT_PACKED_LEAVES = 0x00000400, /* elements start with a signed 64 bit integer key ('cmp' must be NULL). leaves store the keys as bit-packed deltas to their smallest key, and are unpacked on access: pointers to elements of leaves only remain valid until the next call on the tree. lookups modify the tree as well, so they may fail with ENOMEM and must not run concurrently (see btree_get()) */
+	BTREE_OPT_DUP_RUNS = 0x00000800, /* requires BTREE_OPT_MULTI_KEY and 'cmp'. leaves store consecutive elements with equal key bytes (see btree_params_t.key_size/key_offset) as a run: the key once, followed by the remaining bytes of every element. leaves are unpacked on access as for BTREE_OPT_PACKED_LEAVES */
+	BTREE_OPT_VAR_ELEMENTS = 0x00001000, /* elements are of variable length up to 'element_size' (see btree_params_t.element_length); elements handed to the tree only need to be that long. leaves are slotted pages of 'leaf_bytes' (see btree_params_t.leaf_bytes): a slot per element, followed by the elements in their actual length. leaves are split, merged and balanced by the bytes they take rather than by their number of elements, and are unpacked on access as for BTREE_OPT_PACKED_LEAVES */
+	BTREE_OPT_VALUE_LOG = 0x00002000, /* elements are copied into slots of a log owned by the tree, nodes only keep a reference (and, with BTREE_OPT_KEY_COLUMN, the key) of every element, so that rebalancing doesn't move whole elements. elements never move: pointers to them remain valid until they are removed. slots of removed elements are reused */
+	BTREE_OPT_KEY_PREFIX = 0x00004000, /* every node keeps a 64 bit prefix of the key of every element (see btree_params_t.key_prefix), searches call 'cmp' only for elements whose prefix equals the one of the searched key. meant for pointer mode and BTREE_OPT_VALUE_LOG, where 'cmp' has to dereference every element */
+	BTREE_OPT_PERMUTED_LEAVES = 0x00008000, /* leaves keep a byte per element holding the slot of the element within the leaf ('leaf_order' - 1 must not exceed 256), so that insertions, removals and moves between siblings shift those bytes instead of the elements. meant for wide elements and large leaves, narrow elements get slower (see bench/results.md); not available with pointer mode, BTREE_OPT_VALUE_LOG, BTREE_OPT_STRING_KEYS and leaves packed by other options */
 
 	BTREE_OPT_RESERVED = 0xff000000 /* those are used internally (see btree.c) */
 };
@@ -11,18 +11,90 @@ extern "C" {
 #endif
 
 /* TODO version 2 of btree:
- * - use size_t instead of int
  * - calbacks: hand over btree_data() instead of btree_t
- * - alignment alloc
  * - remove iterator: when removing a consecutive series of elements, improve performance and handyness with a remove iterator */
 	
 /* TODO all methods: return -1/NULL and use errno in case of error */
 
+/* element counts and indices. 64 bit by default; define BTREE_INDEX_BITS as 32
+ * (for the library and all of its users alike) to halve the size of the per
+ * child counts within interior nodes, limiting a tree to 2^31 - 1 elements.
+ * signed, so that functions can return an index or a negative error code. */
+#if defined(BTREE_INDEX_BITS) && BTREE_INDEX_BITS == 32
+typedef int32_t btree_index_t;
+#else
+typedef int64_t btree_index_t;
+#endif
+
 typedef struct btree btree_t;
 typedef struct btree_node btree_node_t;
 typedef int (*btree_cmp_t)(btree_t *btree, const void *a, const void *b, void *group);
 typedef int (*btree_acquire_t)(btree_t *btree, void *element);
 typedef void (*btree_release_t)(btree_t *btree, void *element);
+typedef size_t (*btree_string_t)(btree_t *btree, const void *element, const void **bytes); /* BTREE_OPT_STRING_KEYS: set 'bytes' to the key of 'element' and return its length */
+typedef size_t (*btree_length_t)(btree_t *btree, const void *element); /* BTREE_OPT_VAR_ELEMENTS: return the length of 'element' in bytes */
+typedef uint64_t (*btree_prefix_t)(btree_t *btree, const void *element); /* BTREE_OPT_KEY_PREFIX: return the normalized key prefix of 'element' */
+
+/* custom memory allocator used for all memory of a btree.
+ * 'alloc' must return memory aligned to at least 'align' bytes (a power of two),
+ * the memory does not need to be zeroed. 'free' receives the same 'size'
+ * as the corresponding call to 'alloc'. */
+typedef struct {
+	void *(*alloc)(size_t size, size_t align, void *context);
+	void (*free)(void *ptr, size_t size, void *context);
+	void *context;
+} btree_allocator_t;
+
+/* special values for btree_params_t.node_align */
+enum {
+	BTREE_ALIGN_CACHELINE = 64,
+	BTREE_ALIGN_PAGE = -1 /* align nodes to the system page size */
+};
+
+/* layouts for btree_finalize_ex() */
+enum {
+	BTREE_LAYOUT_NODES = 0, /* keep the node structure */
+	BTREE_LAYOUT_SORTED = 1, /* all elements in one sorted array, binary search */
+	BTREE_LAYOUT_EYTZINGER = 2 /* sorted array plus an index of every n-th element in Eytzinger (breadth first) order for cache friendly searches */
+};
+
+/* built-in key types for btree_params_t.key_type */
+enum {
+	BTREE_KEY_NONE = 0,
+	BTREE_KEY_INT32 = 1, /* int32_t */
+	BTREE_KEY_INT64 = 2, /* int64_t */
+	BTREE_KEY_UINT64 = 3 /* uint64_t */
+};
+
+/* searches within a node for btree_params_t.search */
+enum {
+	BTREE_SEARCH_AUTO = 0, /* picked from the order */
+	BTREE_SEARCH_BINARY = 1,
+	BTREE_SEARCH_BRANCHLESS = 2, /* binary search taking the same steps for both outcomes of a comparison, selected by conditional moves */
+	BTREE_SEARCH_LINEAR = 3 /* compare from the first element on, until the position is found */
+};
+
+/* parameters for btree_new_ex(). zero-initialize and set at least 'order'
+ * and 'element_size'; all other members use a default when 0/NULL. */
+typedef struct {
+	int order; /* number of children of interior nodes */
+	int leaf_order; /* leaf nodes hold up to 'leaf_order' - 1 elements. 0: same as 'order' */
+	int element_size;
+	btree_cmp_t cmp;
+	int options;
+	const btree_allocator_t *allocator; /* NULL: use malloc()/free() */
+	int node_align; /* alignment of every node in bytes (power of two or BTREE_ALIGN_PAGE); node sizes are padded accordingly. 0: pointer alignment */
+	int element_align; /* alignment of the element array and thereby of every element in bytes (power of two). 'element_size' must be a multiple of it. 0: no alignment */
+	size_t arena_chunk; /* BTREE_OPT_ARENA: size of a single chunk in bytes */
+	btree_string_t string_key; /* BTREE_OPT_STRING_KEYS: returns the byte string key of an element (or of a key handed to lookup functions); 'cmp' must be NULL */
+	int key_size; /* BTREE_OPT_KEY_COLUMN, BTREE_OPT_DUP_RUNS: size of the key within an element in bytes */
+	int key_offset; /* BTREE_OPT_KEY_COLUMN, BTREE_OPT_DUP_RUNS: offset of the key within an element (or within the record pointed to in pointer mode) */
+	btree_length_t element_length; /* BTREE_OPT_VAR_ELEMENTS: returns the length of an element, at most 'element_size'. elements within the tree are padded with zeros to 'element_size' while unpacked */
+	int leaf_bytes; /* BTREE_OPT_VAR_ELEMENTS, BTREE_OPT_STRING_KEYS: size of a leaf page in bytes (at most 65535), holding a slot per element and the element bytes (string keys: the key bytes following the common prefix, up to a quarter of the page). 0: enough for 'leaf_order' - 1 elements of 'element_size' (string keys: of 16 bytes) if 'leaf_order' is set, otherwise 4096. at least four of those must fit. 'leaf_order' 0: as many elements as fit with a quarter of 'element_size' each (string keys: with 16 bytes each, and at most as many elements of 'element_size' as fit into the page) */
+	btree_prefix_t key_prefix; /* BTREE_OPT_KEY_PREFIX: receives the same arguments as 'cmp'. prefixes must be ordered like their elements: if prefix(a) < prefix(b), then cmp(a, b) < 0 for any group (e.g. the first 8 key bytes, big endian) */
+	int search; /* BTREE_SEARCH_*: how nodes are searched for keys and for indices. built-in keys (see 'key_type') use their own search kernels */
+	int key_type; /* BTREE_KEY_*: elements are ordered by an integer at 'key_offset' ('cmp' must be NULL); keys handed to lookup functions are elements as well, only their key is read. every node keeps a dense copy of its keys, which searches compare with SIMD instructions where the CPU supports them. not available with other options defining the order or packing leaves */
+} btree_params_t;
 
 /*
  * best practices when using keys (i.e. a compare function is given):
@@ -49,18 +121,42 @@ typedef void (*btree_release_t)(btree_t *btree, void *element);
  */
 
 
-/* may be copied; remains valid until next remove/insert operation */
+/* may be copied; remains valid until next remove/insert operation.
+ * trees with packed leaves: only until the next call on the tree, see btree_get() */
 typedef struct {
 	void *element;
-	int index;
+	btree_index_t index;
 	bool found; /* indicator, whether exact match has been found. undefined for find_end() and iterate_prev() */
 
 	/* private */
 	btree_t *tree;
 	btree_node_t *node;
-	int pos;
+	btree_index_t pos;
 } btree_it_t;
 
+/* memory held by a tree, see btree_memory_stats(). all values are maintained
+ * incrementally, so querying them is cheap. */
+typedef struct {
+	uint64_t total; /* all memory held by the tree: tree structure, nodes in use, pooled nodes and arena chunks */
+	uint64_t payload; /* element bytes stored */
+	uint64_t tree; /* tree structure including the overflow slot and the elements of small trees, which are kept within it instead of a separate node */
+	uint64_t overflow; /* overflow element and link within the tree structure, needed for insertions into full nodes */
+	btree_index_t leaf_nodes; /* leaf nodes in use */
+	btree_index_t interior_nodes; /* interior nodes in use */
+	uint64_t leaf_bytes;
+	uint64_t interior_bytes;
+	btree_index_t pooled_nodes; /* unused nodes kept for reuse (BTREE_OPT_KEEP_NODES, btree_reserve()); nodes in the shared pool don't belong to a tree */
+	uint64_t pooled_bytes;
+	uint64_t arena_bytes; /* BTREE_OPT_ARENA: size of all chunks */
+	uint64_t arena_unused; /* BTREE_OPT_ARENA: chunk memory not occupied by nodes (not yet carved, chunk headers) */
+	uint64_t hugepage_bytes; /* BTREE_OPT_HUGE_PAGES: see btree_memory_hugepage() */
+	uint64_t static_bytes; /* static layout of a finalized tree, see btree_finalize_ex() */
+	uint64_t packed_bytes; /* BTREE_OPT_PACKED_LEAVES, BTREE_OPT_DUP_RUNS, BTREE_OPT_VAR_ELEMENTS: packed elements of all leaves (whole pages for BTREE_OPT_VAR_ELEMENTS) */
+	uint64_t unpacked_bytes; /* BTREE_OPT_PACKED_LEAVES, BTREE_OPT_DUP_RUNS, BTREE_OPT_VAR_ELEMENTS: elements of the few most recently used leaves, kept unpacked */
+	uint64_t log_bytes; /* BTREE_OPT_VALUE_LOG: size of all chunks holding the elements */
+	uint64_t log_unused; /* BTREE_OPT_VALUE_LOG: chunk memory not occupied by elements (free slots, not yet used, chunk headers) */
+} btree_memory_stats_t;
+
 /* sets errno in case NULL is returned;
  * creates a btree that stores values, so 'a' and 'b'
  * of cmp callback will point to the values within
@@ -77,6 +173,11 @@ btree_t *btree_new(
 		btree_cmp_t cmp, /* when using an external element, it is guaranteed to be the second operand. */
 		int options);
 
+/* same as btree_new() with extended parameters (see btree_params_t).
+ * the allocator is copied, the context must remain valid until the btree is destroyed. */
+btree_t *btree_new_ex(
+		const btree_params_t *params);
+
 /* 'write' writes btree-specific serialization data to the desired output stream.
  * 'size' returns the serialized size of the given element.
  * 'serialize' writes the 'element' to the output stream. note that this function is expected to write exactly 'size'(element, user) bytes
@@ -100,12 +201,23 @@ btree_t *btree_read(
 		int (*read)(void *di, size_t size, void *user),
 		void *user);
 
+void btree_memory_stats(
+		btree_t *self,
+		btree_memory_stats_t *stats);
+
+/* same as btree_memory_stats().total */
 uint64_t btree_memory_total(
 		btree_t *self);
 
 uint64_t btree_memory_payload(
 		btree_t *self);
 
+/* BTREE_OPT_HUGE_PAGES: number of bytes of node memory in regions successfully
+ * advised for transparent huge pages. whether the kernel actually backs them
+ * with huge pages can be verified via AnonHugePages in /proc/self/smaps. */
+uint64_t btree_memory_hugepage(
+		btree_t *self);
+
 void btree_set_data(
 		btree_t *self,
 		void *data);
@@ -133,15 +245,67 @@ void btree_sethook_refcount(
 int btree_clear(
 		btree_t *self);
 
+/* preallocate enough nodes to hold 'n_elements' elements without calling
+ * the system allocator. unused nodes are kept for reuse until btree_shrink()
+ * is called, even if BTREE_OPT_KEEP_NODES is not set.
+ * returns 0 on success, -ENOMEM if not all nodes could be allocated */
+int btree_reserve(
+		btree_t *self,
+		btree_index_t n_elements);
+
+/* release all nodes kept for reuse (see btree_reserve() and BTREE_OPT_KEEP_NODES)
+ * back to the system and reset the reservation. BTREE_OPT_PACKED_LEAVES, BTREE_OPT_DUP_RUNS: also
+ * pack all leaves which are currently unpacked. BTREE_OPT_VALUE_LOG: also release
+ * all chunks of the log which don't hold any element */
+void btree_shrink(
+		btree_t *self);
+
+/* rebuild the tree bottom-up into densely packed, sequentially allocated nodes.
+ * every node is filled to 'fill_factor' (0 < fill_factor <= 1) of its capacity,
+ * as far as the minimum fill permits. if 'new_order' is not 0, it replaces both
+ * order and leaf order. element order and indices are preserved; iterators and
+ * pointers to elements become invalid.
+ * returns 0 on success, -EINVAL or -ENOMEM (tree remains unchanged) */
+int btree_compact(
+		btree_t *self,
+		double fill_factor,
+		int new_order);
+
+/* BTREE_OPT_SHARED_POOL: limit the number of bytes the central depot keeps
+ * for reuse (default: 16 MiB). nodes exceeding the limit are freed. */
+void btree_pool_set_limit(
+		size_t bytes);
+
+/* BTREE_OPT_SHARED_POOL: free all nodes held by the central depot.
+ * nodes cached by threads are not affected. */
+void btree_pool_trim();
+
 void btree_destroy(
 		btree_t *self);
 
 /* after calling this function, no further insertions/deletions are possible.
  * it is also ensured, that the pointers returned by btree_get() and other methods
- * will be valid until the btree instance is destroyed */
+ * will be valid until the btree instance is destroyed.
+ * exception: trees with packed leaves (BTREE_OPT_PACKED_LEAVES, BTREE_OPT_DUP_RUNS,
+ * BTREE_OPT_VAR_ELEMENTS) only unpack a few leaves at once, so they are converted
+ * to BTREE_LAYOUT_SORTED instead (see btree_finalize_ex()). pointers obtained before
+ * become invalid. if that fails, the tree is not finalized (see btree_is_finalized()) */
 void btree_finalize(
 		btree_t *self);
 
+/* same as btree_finalize(), additionally converts the tree into the given
+ * layout (BTREE_LAYOUT_*). the static layouts store all elements in a single
+ * contiguous allocation without any nodes; lookups, index based access and
+ * iterators work as before. pointers to elements obtained before this call
+ * become invalid.
+ * BTREE_LAYOUT_NODES is turned into BTREE_LAYOUT_SORTED for trees with packed
+ * leaves, see btree_finalize().
+ * returns 0 on success, -EINVAL if the tree has already been converted
+ * or -ENOMEM (tree remains unchanged, but is not finalized) */
+int btree_finalize_ex(
+		btree_t *self,
+		int layout);
+
 int btree_is_finalized(
 		btree_t *self);
 
@@ -155,8 +319,8 @@ bool btree_contains(
 
 int btree_swap(
 		btree_t *self,
-		int index_a,
-		int index_b);
+		btree_index_t index_a,
+		btree_index_t index_b);
 
 /* find lower bound using custom compare function.
  * NOTE: the custom compare function may group together
@@ -178,7 +342,7 @@ int btree_insert(
 
 int btree_insert_at(
 		btree_t *self,
-		int index,
+		btree_index_t index,
 		void *element); /* can be NULL: set NULL pointer (if pointers stored) / zero memory (if values are stored) */
 
 /* insert/replace an element. same as btree_insert but replaces existing elements
@@ -190,7 +354,7 @@ int btree_put(
 
 int btree_put_at(
 		btree_t *self,
-		int index,
+		btree_index_t index,
 		void *element); /* can be NULL: set NULL pointer (if pointers stored) / zero memory (if values are stored); note: cmp function must handle NULL pointers in that case! */
 
 /* removes an element from the tree.
@@ -201,7 +365,7 @@ int btree_remove(
 
 int btree_remove_at(
 		btree_t *self,
-		int index);
+		btree_index_t index);
 
 int btree_remove_group(
 		btree_t *self,
@@ -210,13 +374,13 @@ int btree_remove_group(
 
 int btree_remove_range(
 		btree_t *self,
-		int l,
-		int u);
+		btree_index_t l,
+		btree_index_t u);
 
-int btree_size(
+btree_index_t btree_size(
 		btree_t *self);
 
-int btree_size_group(
+btree_index_t btree_size_group(
 		btree_t *self,
 		const void *key,
 		void *group);
@@ -229,7 +393,17 @@ int btree_size_group(
 
 /* NOTE: the returned pointer is only guaranteed to be valid until
  * any of insert/delete functions have been called EXCEPT when btree_new_ptr was
- * used to create the btree.x
+ * used to create the btree.x (or BTREE_OPT_VALUE_LOG is used: pointers remain
+ * valid until the element is removed)
+ * trees with packed leaves (BTREE_OPT_PACKED_LEAVES, BTREE_OPT_DUP_RUNS,
+ * BTREE_OPT_VAR_ELEMENTS) unpack the leaves accessed into a few buffers owned by
+ * the tree, packing the least recently used leaf again when they run out. for
+ * those trees, every call modifies the tree, lookups and iteration included:
+ * - pointers to elements only remain valid until the next call on the tree
+ * - lookups may fail with ENOMEM (NULL with errno set, -ENOMEM for functions
+ *   returning an index or a count)
+ * - a tree must not be accessed by several threads at once, even if all of
+ *   them only look up elements
  * in case of MULTI_KEY: if multiple elements exist, the
  * FIRST one is returned (i.e. get() and put() operate on the same element) */
 void *btree_get(
@@ -238,7 +412,32 @@ void *btree_get(
 
 void *btree_get_at(
 		btree_t *self,
-		int index);
+		btree_index_t index);
+
+/* btree_get() for 'n' keys at once: the descents are interleaved, so that
+ * their cache misses overlap. 'elements' receives the element found for every
+ * key (NULL if none), 'indices' its index (-ENOENT if none); either may be NULL.
+ * trees with packed leaves keep too few leaves unpacked to return the elements
+ * of a whole batch, so 'elements' must be NULL for them.
+ * returns the number of keys found, -EINVAL or -ENOTSUP ('elements' given for
+ * a tree with packed leaves) */
+btree_index_t btree_get_many(
+		btree_t *self,
+		const void *const *keys,
+		btree_index_t n,
+		void **elements,
+		btree_index_t *indices);
+
+/* btree_get_at() for 'n' indices at once, interleaved as btree_get_many().
+ * indices outside the tree receive NULL. sorted indices are fastest: those
+ * within the leaf of the previous one don't descend at all.
+ * returns the number of indices found, -EINVAL or -ENOTSUP (trees with packed
+ * leaves, see btree_get_many()) */
+btree_index_t btree_get_at_many(
+		btree_t *self,
+		const btree_index_t *indices,
+		btree_index_t n,
+		void **elements);
 
 /* insert a new element. reserve a new slot at a position being fit for 'key'
  * BUT do not copy any data. The caller is responsible for filling the key
@@ -251,76 +450,77 @@ void *btree_get_at(
 		btree_t *self,
 		const void *key);*/
 
-int btree_find(
+btree_index_t btree_find(
 		btree_t *self,
 		const void *key,
 		btree_it_t *it);
 
 /* find functions return index or -ENOENT in case nothing was found.
- * 'it' may be NULL */
-int btree_find_at(
+ * 'it' may be NULL. trees with packed leaves: -ENOMEM if the leaf of the element
+ * found could not be unpacked into 'it' (see btree_get()) */
+btree_index_t btree_find_at(
 		btree_t *self,
-		int index,
+		btree_index_t index,
 		btree_it_t *it);
 
 /* set iterator to first element in btree. if btree is empty, btree_find_end() is returned.
  * returns the index (always 0) */
-int btree_find_begin(
+btree_index_t btree_find_begin(
 		btree_t *self,
 		btree_it_t *it);
 
 /* set iterator to first imaginary element after last element. the returned index
  * also equals the number of elements in the btree. */
-int btree_find_end(
+btree_index_t btree_find_end(
 		btree_t *self,
 		btree_it_t *it);
 
 /* return: iterator points to the first element being >= key and returns index.
  * if all elements are < key, btree_size() is returned. */
-int btree_find_lower(
+btree_index_t btree_find_lower(
 		btree_t *self,
 		const void *key,
 		btree_it_t *it);
 
-int btree_find_upper(
+btree_index_t btree_find_upper(
 		btree_t *self,
 		const void *key,
 		btree_it_t *it);
 
-int btree_find_lower_cmp(
+btree_index_t btree_find_lower_cmp(
 		btree_t *self,
 		btree_cmp_t cmp,
 		const void *key,
 		btree_it_t *it);
 
-int btree_find_upper_cmp(
+btree_index_t btree_find_upper_cmp(
 		btree_t *self,
 		btree_cmp_t cmp,
 		const void *key,
 		btree_it_t *it);
 
 /* returns the first element a in tree for which holds a >= key using given cmp function */
-int btree_find_lower_group(
+btree_index_t btree_find_lower_group(
 		btree_t *self,
 		const void *key,
 		void *group,
 		btree_it_t *it);
 
 /* returns the last element a in tree for which holds a <= key using given cmp function */
-int btree_find_upper_group(
+btree_index_t btree_find_upper_group(
 		btree_t *self,
 		const void *key,
 		void *group,
 		btree_it_t *it);
 
-int btree_find_lower_group_cmp(
+btree_index_t btree_find_lower_group_cmp(
 		btree_t *self,
 		btree_cmp_t cmp,
 		const void *key,
 		void *group,
 		btree_it_t *it);
 
-int btree_find_upper_group_cmp(
+btree_index_t btree_find_upper_group_cmp(
 		btree_t *self,
 		btree_cmp_t cmp,
 		const void *key,
@@ -328,38 +528,38 @@ int btree_find_upper_group_cmp(
 		btree_it_t *it);
 
 /* returns the first element a in tree for which holds a >= key using given cmp function */
-int btree_find_lower_group_in(
+btree_index_t btree_find_lower_group_in(
 		btree_t *self,
-		int l,
-		int u,
+		btree_index_t l,
+		btree_index_t u,
 		const void *key,
 		void *group,
 		btree_it_t *it);
 
 /* returns the last element a in tree for which holds a <= key using given cmp function */
-int btree_find_upper_group_in(
+btree_index_t btree_find_upper_group_in(
 		btree_t *self,
-		int l,
-		int u,
+		btree_index_t l,
+		btree_index_t u,
 		const void *key,
 		void *group,
 		btree_it_t *it);
 
-int btree_find_lower_group_in_cmp(
+btree_index_t btree_find_lower_group_in_cmp(
 		btree_t *self,
 		btree_cmp_t cmp,
-		int l,
-		int u,
+		btree_index_t l,
+		btree_index_t u,
 		const void *key,
 		void *group,
 		btree_it_t *it);
 
 /* returns the last element a in tree for which holds a <= key using given cmp function */
-int btree_find_upper_group_in_cmp(
+btree_index_t btree_find_upper_group_in_cmp(
 		btree_t *self,
 		btree_cmp_t cmp,
-		int l,
-		int u,
+		btree_index_t l,
+		btree_index_t u,
 		const void *key,
 		void *group,
 		btree_it_t *it);
@@ -369,14 +569,29 @@ int btree_find_upper_group_in_cmp(
 int btree_validate_modified(
 		btree_it_t *it);
 
-/* return -ENOENT when trying to process btree_find_end(). */
-int btree_iterate_next(
+/* return -ENOENT when trying to process btree_find_end().
+ * trees with packed leaves: -ENOMEM, see btree_get() */
+btree_index_t btree_iterate_next(
 		btree_it_t *it);
 
-/* return -ENOENT when trying to process btree_find_begin(). */
-int btree_iterate_prev(
+/* return -ENOENT when trying to process btree_find_begin().
+ * trees with packed leaves: -ENOMEM, see btree_get() */
+btree_index_t btree_iterate_prev(
 		btree_it_t *it);
 
+/* same as btree_find_lower()/btree_find_upper(), but start at the position of 'it'
+ * (set by any of the find functions) rather than at the root: only as many levels
+ * are climbed as needed to reach the bound, so that the cost grows with the
+ * logarithm of its distance to 'it'. meant for keys near the previous one, e.g.
+ * sorted batches. 'it' is moved to the bound */
+btree_index_t btree_seek_lower(
+		btree_it_t *it,
+		const void *key);
+
+btree_index_t btree_seek_upper(
+		btree_it_t *it,
+		const void *key);
+
 void btree_dump(
 		btree_t *self,
 		void (*print)(const void *element));
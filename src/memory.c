@@ -5,11 +5,16 @@
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SIMD_X86 /* search kernels for built-in keys, chosen at runtime, see int_kernel() */
+#endif
 
 #include "../include/memory.h"
-
-/* TODO possible memory usage optimization:
- * different size for leaf nodes and itermediate nodes: leafs don't need link offset/count */
+#include "pool.h"
 
 enum {
 	OPT_NOCMP = 0x01000000, /* no compare function given, use indices only */
@@ -20,11 +25,49 @@ enum {
 #define MIN(X, Y) ((X) < (Y) ? (X) : (Y))
 #define MAX(X, Y) ((X) > (Y) ? (X) : (Y))
 
-/* set element to a pointer value */
+/* round up (down) to a multiple of A, which must be a power of two */
+#define ALIGN_UP(X, A) (((X) + (A) - 1) & ~((size_t)(A) - 1))
+#define ALIGN_DOWN(X, A) ((X) & ~((size_t)(A) - 1))
+
+#define NODE_ALIGN sizeof(void*)
+
+enum { /* node kinds; leaf nodes don't have links */
+	NODE_LEAF = 0,
+	NODE_INTERIOR = 1
+};
+#define ARENA_CHUNK_DEFAULT (64 * 1024)
+#define LOG_CHUNK (64 * 1024) /* BTREE_OPT_VALUE_LOG: size of a chunk of element slots, unless a single slot needs more */
+#define MAX_LEVELS 32 /* every node except root has at least two children */
+#define STATIC_BLOCK_BYTES 256 /* BTREE_LAYOUT_EYTZINGER: bytes of sorted elements covered by a single index sample */
+#define STRING_PREFIX 62 /* BTREE_OPT_STRING_KEYS: bytes of the common prefix kept per interior node ... */
+#define STRING_LEAF_PREFIX 254 /* ... and per leaf */
+#define STRING_WINDOW 15 /* BTREE_OPT_STRING_KEYS: bytes following the prefix kept per key by interior nodes */
+#define STRING_STALE UINT16_MAX /* BTREE_OPT_STRING_KEYS: prefix length of a leaf whose keys exceed its page, see string_page() */
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024) /* transparent huge page size on x86-64 and most aarch64 kernels */
+#define PACKED_OPEN 8 /* BTREE_OPT_PACKED_LEAVES: leaves kept unpacked at most; a single operation uses up to four */
+#define PACKED_SLACK sizeof(uint64_t) /* BTREE_OPT_PACKED_LEAVES: padding after the deltas, so that every delta can be read by a single 64 bit load */
+#define PAGE_BYTES 4096 /* BTREE_OPT_VAR_ELEMENTS: default byte budget of a leaf page */
+#define PAGE_MIN_ELEMENTS 4 /* BTREE_OPT_VAR_ELEMENTS: elements of 'element_size' a leaf page holds at least, so that halves of a split page fit */
+#define SMALL_ELEMENTS 15 /* elements held by the inline root of small trees at most ... */
+#define SMALL_BYTES 512 /* ... and bytes at most, see small_promote() */
+#define LINEAR_ORDER 8 /* BTREE_SEARCH_AUTO: search keys linearly in nodes of at most this order */
+#define LINEAR_LINKS 64 /* BTREE_SEARCH_AUTO: search indices linearly in nodes of at most this order */
+#define CACHE_LINE 64
+#define PREFETCH_LINES 8 /* cache lines of a node fetched ahead of its search at most */
+#define PREFETCH_SPAN (4 * CACHE_LINE) /* keys of a node taking at most this many bytes are fetched completely */
+#define BATCH_LOOKUPS 16 /* btree_get_many()/btree_get_at_many(): descents advanced together */
+#define INT_VECTOR 32 /* built-in keys: bytes compared at once by the widest search kernel; the keys of a node are padded to a multiple */
+
+/* set element to a pointer value. BTREE_OPT_VAR_ELEMENTS: the given
+ * element is only as long as it claims to be, see var_length() */
 #define SET_EP(TREE, E, V) \
 	do { \
 		if(TREE->options & OPT_USE_POINTERS) \
 			*(const void**)(E) = V; \
+		else if(TREE->options & BTREE_OPT_VAR_ELEMENTS) { \
+			memcpy(E, V, var_length(TREE, V)); \
+			memset((void*)(E) + var_length(TREE, V), 0, TREE->element_size - var_length(TREE, V)); \
+		} \
 		else \
 			memcpy(E, V, TREE->element_size); \
 	} while(false)
@@ -51,12 +94,123 @@ static void dump_node(
 		btree_node_t *node,
 		void (*print)(const void *element));
 
+static void leaf_discard(
+		btree_t *tree,
+		btree_node_t *node);
+
+static int adjust(
+		btree_t *tree,
+		btree_node_t *node);
+
 typedef struct {
-	int count;
-	int offset;
+	btree_index_t count;
+	btree_index_t offset;
 	btree_node_t *child;
 } btree_link_t;
 
+/* arena chunk; nodes are carved from the memory following this header */
+typedef struct btree_chunk btree_chunk_t;
+struct btree_chunk {
+	btree_chunk_t *next;
+	size_t size; /* total size including header */
+	int flags;
+	int used; /* BTREE_OPT_VALUE_LOG: slots holding an element */
+};
+
+enum { /* chunk flags */
+	CHUNK_MAPPED = 0x1, /* allocated by mmap() instead of the tree allocator */
+	CHUNK_HUGE = 0x2 /* advised for transparent huge pages */
+};
+
+#define CHUNK_HEADER ALIGN_UP(sizeof(btree_chunk_t), 16)
+
+/* BTREE_OPT_STRING_KEYS: search data following the elements of every node;
+ * a head followed by one slot per element for interior nodes, and by a page
+ * of 'leaf_bytes' holding the remaining bytes of every key for leaves */
+typedef struct {
+	uint16_t prefix_len; /* length of the prefix common to all keys of the node */
+	uint16_t end; /* leaves: start of the key bytes within the page, see string_page_insert() */
+	uint8_t prefix[]; /* STRING_PREFIX bytes, STRING_LEAF_PREFIX for leaves, see string_head_size() */
+} string_head_t;
+
+typedef struct {
+	uint8_t bytes[STRING_WINDOW]; /* key bytes following the common prefix */
+	uint8_t len; /* number of key bytes following the common prefix; STRING_WINDOW + 1 if there are more */
+} string_slot_t;
+
+/* BTREE_OPT_STRING_KEYS: bytes of the head of a node of 'kind', its slots (or page) follow */
+static inline size_t string_head_size(
+		int kind)
+{
+	return ALIGN_UP(sizeof(string_head_t) + (kind == NODE_LEAF ? STRING_LEAF_PREFIX : STRING_PREFIX), sizeof(uint16_t));
+}
+
+/* BTREE_OPT_PACKED_LEAVES: kept by every leaf following the node structure.
+ * keys are stored as deltas to the smallest key (frame of reference), each
+ * 'width' bits wide, followed by the remaining bytes of every element.
+ * BTREE_OPT_DUP_RUNS: the end of every run (uint16_t), followed by the key
+ * of every run and the remaining bytes of every element.
+ * BTREE_OPT_VAR_ELEMENTS: a slotted page of 'leaf_bytes', see page_slot_t */
+typedef struct {
+	void *block; /* packed elements, NULL if the leaf has never been packed */
+	size_t block_size;
+	int64_t base; /* smallest key */
+	uint64_t span; /* largest key minus 'base' */
+	int width; /* bits per delta: 0 to 56 or 64 */
+	int runs; /* BTREE_OPT_DUP_RUNS: number of runs */
+	bool dirty; /* unpacked elements have changed, see node_changed() */
+	uint64_t used; /* last use while unpacked, see leaf_open() */
+} packed_leaf_t;
+
+/* BTREE_OPT_VAR_ELEMENTS: slot directory entry of a leaf page. the slots
+ * follow each other from the start of the page, the elements are stored in
+ * their actual length from its end towards the slots, each aligned to
+ * 'element_align'. leaves are split and merged by the bytes they take
+ * within their page, see page_adjust() */
+typedef struct {
+	uint16_t offset; /* of the element within the page */
+	uint16_t length;
+} page_slot_t;
+
+/* built-in keys: number of the first 'n' (sorted) keys of a node which
+ * are less than 'key' (not greater than 'key' if 'upper'), see int_kernel() */
+typedef int (*int_count_t)(const void *keys, int n, int64_t key, bool upper);
+
+enum { /* how a search compares against the elements of a node */
+	SEARCH_CALLBACK = 0, /* call the compare function with each element */
+	SEARCH_STRING, /* BTREE_OPT_STRING_KEYS: compare against the prefix and slots of the node */
+	SEARCH_COLUMN, /* BTREE_OPT_KEY_COLUMN: call the key compare function with the keys of the node */
+	SEARCH_PACKED, /* BTREE_OPT_PACKED_LEAVES: compare integer keys, packed leaves by their deltas */
+	SEARCH_PREFIX, /* BTREE_OPT_KEY_PREFIX: compare the prefixes of the node, call the compare function on ties */
+	SEARCH_INT /* built-in keys: compare against the keys of the node, whole nodes at once, see node_bound() */
+};
+
+/* search key, prepared once per search and per node visited */
+typedef struct {
+	int mode;
+	const uint8_t *bytes; /* SEARCH_STRING: key bytes */
+	size_t len;
+	int node_cmp; /* result for all elements of the current node if the key doesn't share its prefix; 0: compare slots */
+	int prefix_len; /* prefix length of the current node */
+	const string_slot_t *slots; /* slots of the current node */
+	const uint8_t *page; /* page of the current node if it is a leaf, see string_page() */
+	int64_t key; /* SEARCH_PACKED, SEARCH_INT (see int_key()) */
+	uint64_t delta; /* SEARCH_PACKED: key minus the base of the current node */
+	const packed_leaf_t *packed; /* current node is a packed leaf, its elements are not available */
+	uint64_t prefix; /* SEARCH_PREFIX */
+} search_key_t;
+
+/* btree_get_many()/btree_get_at_many(): state of a single descent */
+typedef struct {
+	btree_node_t *cur; /* node searched next; NULL once done */
+	btree_node_t *node; /* position found so far */
+	btree_index_t pos;
+	bool found;
+	int link; /* btree_get_many(): link of 'cur' descended next */
+	btree_index_t offset; /* btree_get_at_many(): index of the first element within the subtree of 'cur' */
+	search_key_t q; /* btree_get_many() */
+} lookup_t;
+
 #ifdef TESTING
 /* testing: some structures are set up manually, so the usual
  * btree_clear()/btree_destroy() won't free those nodes.
@@ -86,10 +240,10 @@ typedef struct {
 
 struct btree_node {
 	btree_node_t *parent;
+	btree_link_t *links; /* 'order' links; NULL for leaf nodes */
+	void *elements; /* 'order' - 1 elements ('leaf_order' - 1 for leaf nodes) */
+	btree_index_t fill; /* number of elements in node; the static root holds all elements of the tree */
 	int child_index;
-	int fill; /* number of elements in node */
-	btree_link_t *links; /* 'order' links */
-	void *elements; /* 'order' - 1 elements */
 #ifdef TESTING
 	btree_node_t *prev_alloc;
 	btree_node_t *next_alloc;
@@ -98,6 +252,7 @@ struct btree_node {
 
 struct btree {
 	int order;
+	int leaf_order;
 	int element_size;
 	int options;
 
@@ -106,46 +261,605 @@ struct btree {
 	int (*hook_cmp)(btree_t *btree, const void *a, const void *b, void *group); /* compare function. 'data': only used by '_group' methods which specify an additional data argument */
 	int (*hook_acquire)(btree_t *btree, void *a);
 	void (*hook_release)(btree_t *btree, void *a);
+	btree_string_t hook_string; /* BTREE_OPT_STRING_KEYS: key bytes of an element */
+	btree_length_t hook_length; /* BTREE_OPT_VAR_ELEMENTS: length of an element */
+	int leaf_bytes; /* BTREE_OPT_VAR_ELEMENTS: byte budget of a leaf page */
+	btree_prefix_t hook_prefix; /* BTREE_OPT_KEY_PREFIX: key prefix of an element */
+	btree_cmp_t hook_key_cmp; /* BTREE_OPT_KEY_COLUMN: compare function given by the user, receives keys instead of elements */
+	int key_size; /* BTREE_OPT_KEY_COLUMN, BTREE_OPT_DUP_RUNS, built-in keys */
+	int key_offset; /* BTREE_OPT_KEY_COLUMN, BTREE_OPT_DUP_RUNS, built-in keys */
+	int key_type; /* BTREE_KEY_* */
+	int_count_t int_count; /* built-in keys: search kernel, see int_kernel() */
+	int search_param; /* btree_params_t.search */
+	int search; /* BTREE_SEARCH_* used for keys with the current order, see choose_search() */
+	int link_search; /* BTREE_SEARCH_* used for indices with the current order */
 	void *data;
 	void *group_default;
+	btree_allocator_t allocator;
+	size_t node_align; /* alignment of nodes in bytes */
+	size_t element_align; /* alignment of the element array within nodes and of the overflow element */
+	size_t node_bytes[2]; /* node size by kind, see setup_layout() */
+	size_t elements_offset[2]; /* offset of the element array within a node by kind */
+	size_t cache_offset[2]; /* offset of data derived from the elements for faster searches by kind, see node_changed() */
+	size_t perm_offset; /* BTREE_OPT_PERMUTED_LEAVES: offset of the slot indices within a leaf */
+	size_t prefetch[PREFETCH_LINES]; /* offsets of the cache lines fetched ahead of searching a node, see setup_prefetch() */
+	int n_prefetch;
+	pool_class_t *shared[2]; /* BTREE_OPT_SHARED_POOL: process-wide pool used for nodes (one per node kind) */
+
+	struct { /* BTREE_OPT_ARENA: nodes are carved from chunks; chunks are only released as a whole */
+		btree_chunk_t *first;
+		btree_chunk_t *cur; /* chunk currently used for carving */
+		void *pos; /* next free byte in 'cur' */
+		void *end; /* end of 'cur' */
+		size_t chunk_size;
+		uint64_t bytes; /* total size of all chunks */
+		uint64_t huge_bytes; /* total size of chunks advised for huge pages */
+	} arena;
+
+	struct { /* BTREE_OPT_VALUE_LOG: slots holding the elements, carved from chunks; nodes store pointers to them */
+		btree_chunk_t *first;
+		void *pos; /* next slot never used within 'first' */
+		void *end; /* end of 'first' */
+		void *free; /* slots of removed elements, linked through their first bytes */
+		size_t value_size; /* size of an element */
+		size_t slot_size;
+		size_t chunk_size; /* a power of two; chunks are aligned to their size, see log_chunk() */
+		uint64_t bytes; /* total size of all chunks */
+		uint64_t slots; /* number of slots in use */
+	} log;
+
+	struct { /* packed leaves: leaves currently unpacked, see leaf_open() */
+		btree_node_t *open[PACKED_OPEN];
+		int n_open;
+		uint64_t clock; /* source of packed_leaf_t.used */
+		uint64_t block_bytes; /* size of all packed blocks */
+	} packed;
+
+	struct { /* static layout of a finalized tree, see btree_finalize_ex() */
+		btree_node_t root; /* leaf node holding all elements; used as 'root' */
+		void *alloc; /* sorted elements, followed by the index */
+		size_t size; /* size of 'alloc' in bytes */
+		void *samples; /* BTREE_LAYOUT_EYTZINGER: every 'block'-th element in Eytzinger order, 1-based */
+		btree_index_t *ranks; /* position of each sample within the sorted elements */
+		btree_index_t n_samples;
+		int block;
+	} layout;
 
 	btree_node_t *root;
+	/* the following are indexed by node kind */
+	btree_node_t *pool[2]; /* unused nodes kept for reuse, linked via 'parent' */
+	btree_index_t pool_size[2]; /* number of nodes in 'pool' */
+	btree_index_t nodes[2]; /* number of nodes currently part of the tree */
+	btree_index_t reserve[2]; /* keep at least this many nodes (used + pooled) allocated, see btree_reserve() */
 	btree_node_t *overflow_node;
 	void *overflow_element;
 	btree_link_t overflow_link;
+	btree_node_t small; /* root leaf of small trees; its elements follow the overflow element, so that no node is allocated */
+	int small_max; /* number of elements 'small' has room for */
 /*	struct { used to track a slot during adjust(). feature enabled if node != NULL
 		btree_node_t *node;
 		int pos;
 	} track;*/
 };
 
+static void *default_alloc(
+		size_t size,
+		size_t align,
+		void *context)
+{
+	void *ptr;
+
+	(void)context;
+	if(align <= sizeof(void*))
+		return malloc(size);
+	else if(posix_memalign(&ptr, align, size) != 0)
+		return NULL;
+	else
+		return ptr;
+}
+
+static void default_free(
+		void *ptr,
+		size_t size,
+		void *context)
+{
+	(void)size;
+	(void)context;
+	free(ptr);
+}
+
+/* the overflow element is located right after the tree structure,
+ * followed by the elements of the inline root */
+static inline size_t tree_size(
+		int element_size,
+		size_t element_align,
+		int small_max)
+{
+	return ALIGN_UP(sizeof(btree_t), element_align) + element_size * (1 + small_max);
+}
+
 static btree_t *alloc_tree(
-		int element_size)
+		const btree_allocator_t *allocator,
+		int element_size,
+		size_t element_align,
+		int small_max)
 {
 	void *alloc;
 	btree_t *tree;
 
-	alloc = calloc(1, sizeof(btree_t) + element_size);
+	alloc = allocator->alloc(tree_size(element_size, element_align, small_max), MAX(NODE_ALIGN, element_align), allocator->context);
 	if(alloc == NULL)
 		return NULL;
+	memset(alloc, 0, tree_size(element_size, element_align, small_max));
 
 	tree = alloc;
-	tree->overflow_element = alloc + sizeof(btree_t);
+	tree->allocator = *allocator;
+	tree->element_align = element_align;
+	tree->overflow_element = alloc + ALIGN_UP(sizeof(btree_t), element_align);
+	tree->small.elements = tree->overflow_element + element_size;
+	tree->small_max = small_max;
 	return tree;
 }
 
-static btree_node_t *alloc_node(
+static void free_tree(
+		btree_t *tree)
+{
+	btree_allocator_t allocator = tree->allocator;
+	allocator.free(tree, tree_size(tree->element_size, tree->element_align, tree->small_max), allocator.context);
+}
+
+/* BTREE_OPT_HUGE_PAGES: map a chunk aligned to the huge page size and advise
+ * it for transparent huge pages. returns NULL if mmap() fails; if the advice
+ * is rejected (e.g. THP disabled), the chunk is kept with regular pages. */
+static btree_chunk_t *huge_chunk_alloc(
+		btree_t *tree,
+		size_t size)
+{
+	void *map;
+	void *aligned;
+	btree_chunk_t *chunk;
+
+	size = ALIGN_UP(size, HUGE_PAGE_SIZE);
+	map = mmap(NULL, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(map == MAP_FAILED)
+		return NULL;
+	/* trim the mapping to an aligned region, so that the kernel can back it with huge pages entirely */
+	aligned = (void*)ALIGN_UP((uintptr_t)map, HUGE_PAGE_SIZE);
+	if(aligned != map)
+		munmap(map, aligned - map);
+	if(aligned + size != map + size + HUGE_PAGE_SIZE)
+		munmap(aligned + size, map + HUGE_PAGE_SIZE - aligned);
+
+	chunk = aligned;
+	chunk->size = size;
+	chunk->flags = CHUNK_MAPPED;
+#ifdef MADV_HUGEPAGE
+	if(madvise(aligned, size, MADV_HUGEPAGE) == 0) {
+		chunk->flags |= CHUNK_HUGE;
+		tree->arena.huge_bytes += size;
+	}
+#endif
+	return chunk;
+}
+
+static void *arena_alloc(
+		btree_t *tree,
+		size_t size)
+{
+	btree_chunk_t *chunk = tree->arena.cur;
+	size_t header = ALIGN_UP(CHUNK_HEADER, tree->node_align); /* first node of a chunk must be aligned as well */
+	void *ptr;
+
+	while(chunk == NULL || (size_t)(tree->arena.end - tree->arena.pos) < size) {
+		if(chunk == NULL)
+			chunk = tree->arena.first; /* arena has been rewound or is still empty */
+		else
+			chunk = chunk->next;
+		if(chunk == NULL) { /* no more chunks, allocate a new one and append it */
+			chunk = NULL;
+			if((tree->options & BTREE_OPT_HUGE_PAGES) != 0)
+				chunk = huge_chunk_alloc(tree, MAX(tree->arena.chunk_size, header + size));
+			if(chunk == NULL) { /* regular chunk, or fall back if mapping failed */
+				chunk = tree->allocator.alloc(MAX(tree->arena.chunk_size, header + size), MAX(16, tree->node_align), tree->allocator.context);
+				if(chunk == NULL)
+					return NULL;
+				chunk->size = MAX(tree->arena.chunk_size, header + size);
+				chunk->flags = 0;
+			}
+			chunk->next = NULL;
+			tree->arena.bytes += chunk->size;
+			if(tree->arena.cur != NULL)
+				tree->arena.cur->next = chunk;
+			else
+				tree->arena.first = chunk;
+		}
+		tree->arena.cur = chunk;
+		tree->arena.pos = (void*)chunk + header;
+		tree->arena.end = (void*)chunk + chunk->size;
+	}
+	ptr = tree->arena.pos;
+	tree->arena.pos += size;
+	return ptr;
+}
+
+/* make the whole arena available for carving again; all nodes become invalid */
+static void arena_rewind(
+		btree_t *tree)
+{
+	tree->arena.cur = NULL;
+	tree->arena.pos = NULL;
+	tree->arena.end = NULL;
+}
+
+static void arena_release(
+		btree_t *tree)
+{
+	btree_chunk_t *next;
+
+	while(tree->arena.first != NULL) {
+		next = tree->arena.first->next;
+		if((tree->arena.first->flags & CHUNK_MAPPED) != 0)
+			munmap(tree->arena.first, tree->arena.first->size);
+		else
+			tree->allocator.free(tree->arena.first, tree->arena.first->size, tree->allocator.context);
+		tree->arena.first = next;
+	}
+	tree->arena.bytes = 0;
+	tree->arena.huge_bytes = 0;
+	arena_rewind(tree);
+}
+
+/* BTREE_OPT_VALUE_LOG: the chunk containing a slot */
+static inline btree_chunk_t *log_chunk(
+		btree_t *tree,
+		void *slot)
+{
+	return (btree_chunk_t*)((uintptr_t)slot & ~(uintptr_t)(tree->log.chunk_size - 1));
+}
+
+/* BTREE_OPT_VALUE_LOG: a slot holding a copy of 'element' (zeroes if NULL) */
+static void *log_alloc(
+		btree_t *tree,
+		const void *element)
+{
+	size_t header = ALIGN_UP(CHUNK_HEADER, tree->element_align);
+	btree_chunk_t *chunk;
+	void *slot;
+
+	if(tree->log.free != NULL) { /* reuse the slot of a removed element */
+		slot = tree->log.free;
+		memcpy(&tree->log.free, slot, sizeof(void*));
+	}
+	else {
+		if(tree->log.first == NULL || (size_t)(tree->log.end - tree->log.pos) < tree->log.slot_size) { /* append a new chunk */
+			chunk = tree->allocator.alloc(tree->log.chunk_size, tree->log.chunk_size, tree->allocator.context);
+			if(chunk == NULL)
+				return NULL;
+			chunk->size = tree->log.chunk_size;
+			chunk->flags = 0;
+			chunk->used = 0;
+			chunk->next = tree->log.first;
+			tree->log.first = chunk;
+			tree->log.bytes += chunk->size;
+			tree->log.pos = (void*)chunk + header;
+			tree->log.end = (void*)chunk + chunk->size;
+		}
+		slot = tree->log.pos;
+		tree->log.pos += tree->log.slot_size;
+	}
+	if(element == NULL)
+		memset(slot, 0, tree->log.value_size);
+	else
+		memcpy(slot, element, tree->log.value_size);
+	log_chunk(tree, slot)->used++;
+	tree->log.slots++;
+	return slot;
+}
+
+/* BTREE_OPT_VALUE_LOG: keep the slot of a removed element for reuse */
+static void log_free(
+		btree_t *tree,
+		void *slot)
+{
+	memcpy(slot, &tree->log.free, sizeof(void*));
+	tree->log.free = slot;
+	log_chunk(tree, slot)->used--;
+	tree->log.slots--;
+}
+
+/* BTREE_OPT_VALUE_LOG: release the chunks without any element, their
+ * free slots are dropped from the free list first */
+static void log_trim(
+		btree_t *tree)
+{
+	btree_chunk_t **link = &tree->log.first;
+	btree_chunk_t *chunk;
+	void *slot = tree->log.free;
+	void *next;
+	void **tail = &tree->log.free;
+
+	while(slot != NULL) {
+		memcpy(&next, slot, sizeof(void*));
+		if(log_chunk(tree, slot)->used > 0) {
+			memcpy(tail, &slot, sizeof(void*));
+			tail = slot;
+		}
+		slot = next;
+	}
+	memcpy(tail, &slot, sizeof(void*));
+
+	while(*link != NULL) {
+		chunk = *link;
+		if(chunk->used > 0) {
+			link = &chunk->next;
+			continue;
+		}
+		if(chunk == tree->log.first) { /* slots are carved from the first chunk only */
+			tree->log.pos = NULL;
+			tree->log.end = NULL;
+		}
+		*link = chunk->next;
+		tree->log.bytes -= chunk->size;
+		tree->allocator.free(chunk, chunk->size, tree->allocator.context);
+	}
+}
+
+/* BTREE_OPT_VALUE_LOG: release all slots at once */
+static void log_release(
+		btree_t *tree)
+{
+	btree_chunk_t *next;
+
+	while(tree->log.first != NULL) {
+		next = tree->log.first->next;
+		tree->allocator.free(tree->log.first, tree->log.first->size, tree->allocator.context);
+		tree->log.first = next;
+	}
+	tree->log.pos = NULL;
+	tree->log.end = NULL;
+	tree->log.free = NULL;
+	tree->log.bytes = 0;
+	tree->log.slots = 0;
+}
+
+static inline bool isleaf(
+		btree_node_t *node)
+{
+	return node->links == NULL;
+}
+
+/* the tree has been converted into a static layout */
+static inline bool isstatic(
+		btree_t *tree)
+{
+	return tree->root == &tree->layout.root;
+}
+
+/* leaves are kept packed and unpacked on access, see leaf_open() */
+static inline bool packs_leaves(
+		btree_t *tree)
+{
+	return (tree->options & (BTREE_OPT_PACKED_LEAVES | BTREE_OPT_DUP_RUNS | BTREE_OPT_VAR_ELEMENTS)) != 0;
+}
+
+/* BTREE_OPT_VAR_ELEMENTS, BTREE_OPT_STRING_KEYS: the node is a leaf kept in a page of 'leaf_bytes', see page_adjust() */
+static inline bool paged(
+		btree_t *tree,
+		btree_node_t *node)
+{
+	return (tree->options & (BTREE_OPT_VAR_ELEMENTS | BTREE_OPT_STRING_KEYS)) != 0 && isleaf(node) && node != &tree->layout.root;
+}
+
+/* BTREE_OPT_PERMUTED_LEAVES: elements of the node are addressed through its slot indices */
+static inline bool permutes(
+		btree_t *tree,
+		btree_node_t *node)
+{
+	return (tree->options & BTREE_OPT_PERMUTED_LEAVES) != 0 && isleaf(node) && node != &tree->layout.root;
+}
+
+/* slot of the element at every position, followed by the unused slots */
+static inline uint8_t *node_perm(
+		btree_t *tree,
+		btree_node_t *node)
+{
+	return (void*)node + tree->perm_offset;
+}
+
+/* element at position 'pos' of a node */
+static inline void *node_element(
+		btree_t *tree,
+		btree_node_t *node,
+		btree_index_t pos)
+{
+	if(permutes(tree, node))
+		pos = node_perm(tree, node)[pos];
+	return node->elements + pos * tree->element_size;
+}
+
+static inline int node_kind(
+		btree_node_t *node)
+{
+	return isleaf(node) ? NODE_LEAF : NODE_INTERIOR;
+}
+
+static inline size_t node_size(
+		btree_t *tree,
+		int kind)
+{
+	return tree->node_bytes[kind];
+}
+
+/* fetch the cache line at 'offset' of every node ahead of its search,
+ * unless it already is or enough lines are */
+static void add_prefetch(
+		btree_t *tree,
+		size_t offset)
+{
+	int i;
+
+	offset -= offset % CACHE_LINE;
+	for(i = 0; i < tree->n_prefetch; i++)
+		if(tree->prefetch[i] == offset)
+			return;
+	if(tree->n_prefetch < PREFETCH_LINES)
+		tree->prefetch[tree->n_prefetch++] = offset;
+}
+
+/* pick the cache lines fetched as soon as a node is known to be searched
+ * next (see fetch_node()). the kind of the node isn't known before it arrived,
+ * so lines of both kinds are fetched: the header, and the keys within
+ * [start, end) of each kind. keys spanning many lines are fetched where the
+ * first steps of a binary search compare them */
+static void setup_prefetch(
+		btree_t *tree,
+		const size_t *start,
+		const size_t *end)
+{
+	size_t offset;
+	size_t len;
+	int kind;
+
+	tree->n_prefetch = 0;
+	add_prefetch(tree, 0);
+	for(kind = NODE_LEAF; kind <= NODE_INTERIOR; kind++) {
+		len = end[kind] - start[kind];
+		if(len <= PREFETCH_SPAN)
+			for(offset = start[kind]; offset < end[kind]; offset += CACHE_LINE)
+				add_prefetch(tree, offset);
+		else {
+			add_prefetch(tree, start[kind] + len / 2);
+			add_prefetch(tree, start[kind] + len / 4);
+			add_prefetch(tree, start[kind] + len / 2 + len / 4);
+		}
+	}
+}
+
+/* calculate node sizes and element offsets from order and alignment.
+ * nodes are padded to a multiple of the node alignment, so that consecutive
+ * nodes carved from an arena are aligned as well. */
+static void setup_layout(
+		btree_t *tree)
+{
+	size_t search_start[2];
+	size_t search_end[2];
+	size_t end;
+	int order;
+	int kind;
+
+	tree->elements_offset[NODE_LEAF] = ALIGN_UP(sizeof(btree_node_t), tree->element_align);
+	tree->elements_offset[NODE_INTERIOR] = ALIGN_UP(sizeof(btree_node_t) + sizeof(btree_link_t) * tree->order, tree->element_align);
+	for(kind = NODE_LEAF; kind <= NODE_INTERIOR; kind++) {
+		order = kind == NODE_LEAF ? tree->leaf_order : tree->order;
+		end = tree->elements_offset[kind] + tree->element_size * (order - 1);
+		search_start[kind] = tree->elements_offset[kind]; /* bytes read by searches, see setup_prefetch() */
+		if((tree->options & BTREE_OPT_PERMUTED_LEAVES) != 0 && kind == NODE_LEAF) { /* slot indices follow the elements */
+			tree->perm_offset = end;
+			end += order - 1;
+		}
+		if(packs_leaves(tree) && kind == NODE_LEAF) { /* elements are kept outside of the node */
+			tree->cache_offset[kind] = ALIGN_UP(sizeof(btree_node_t), sizeof(uint64_t));
+			search_start[kind] = tree->cache_offset[kind];
+			end = tree->cache_offset[kind] + sizeof(packed_leaf_t);
+		}
+		else if((tree->options & BTREE_OPT_STRING_KEYS) != 0) { /* leaves keep a page of key bytes, see string_page() */
+			tree->cache_offset[kind] = ALIGN_UP(end, sizeof(uint16_t));
+			search_start[kind] = tree->cache_offset[kind];
+			end = tree->cache_offset[kind] + string_head_size(kind) + (kind == NODE_LEAF ? (size_t)tree->leaf_bytes : sizeof(string_slot_t) * (order - 1));
+		}
+		else if((tree->options & BTREE_OPT_KEY_COLUMN) != 0) {
+			tree->cache_offset[kind] = ALIGN_UP(end, MAX(NODE_ALIGN, tree->element_align));
+			search_start[kind] = tree->cache_offset[kind];
+			end = tree->cache_offset[kind] + tree->key_size * (order - 1);
+		}
+		else if((tree->options & BTREE_OPT_KEY_PREFIX) != 0) {
+			tree->cache_offset[kind] = ALIGN_UP(end, sizeof(uint64_t));
+			search_start[kind] = tree->cache_offset[kind];
+			end = tree->cache_offset[kind] + sizeof(uint64_t) * (order - 1);
+		}
+		else if(tree->key_type != BTREE_KEY_NONE) { /* kernels read whole vectors */
+			tree->cache_offset[kind] = ALIGN_UP(end, sizeof(uint64_t));
+			search_start[kind] = tree->cache_offset[kind];
+			end = tree->cache_offset[kind] + tree->key_size * ALIGN_UP(order - 1, INT_VECTOR / tree->key_size);
+		}
+		search_end[kind] = end;
+		tree->node_bytes[kind] = ALIGN_UP(end, tree->node_align);
+	}
+	setup_prefetch(tree, search_start, search_end);
+}
+
+/* pick the searches within nodes. a linear search wins as long as it takes
+ * few more comparisons than a binary one, which for keys (every comparison
+ * being a call of 'cmp') are only very small nodes, but for the offsets of
+ * links nodes of moderate order. otherwise the branchless search avoids a
+ * mispredicted branch on every step */
+static void choose_search(
 		btree_t *tree)
+{
+	int order = MAX(tree->order, tree->leaf_order);
+
+	if(tree->search_param != BTREE_SEARCH_AUTO) {
+		tree->search = tree->search_param;
+		tree->link_search = tree->search_param;
+	}
+	else {
+		tree->search = order <= LINEAR_ORDER ? BTREE_SEARCH_LINEAR : BTREE_SEARCH_BRANCHLESS;
+		tree->link_search = tree->order <= LINEAR_LINKS ? BTREE_SEARCH_LINEAR : BTREE_SEARCH_BRANCHLESS;
+	}
+}
+
+/* fresh, uninitialized memory for a single node */
+static void *node_memory(
+		btree_t *tree,
+		int kind)
+{
+	if((tree->options & BTREE_OPT_ARENA) != 0)
+		return arena_alloc(tree, node_size(tree, kind));
+	else if(tree->shared[kind] != NULL)
+		return node_pool_alloc(tree->shared[kind]);
+	else
+		return tree->allocator.alloc(node_size(tree, kind), tree->node_align, tree->allocator.context);
+}
+
+static void node_memory_free(
+		btree_t *tree,
+		int kind,
+		void *node)
+{
+	if(tree->shared[kind] != NULL)
+		node_pool_free(tree->shared[kind], node);
+	else
+		tree->allocator.free(node, node_size(tree, kind), tree->allocator.context);
+}
+
+static btree_node_t *alloc_node(
+		btree_t *tree,
+		int kind)
 {
 	void *alloc;
 	btree_node_t *node;
+	int i;
 
-	alloc = calloc(1, sizeof(btree_node_t) + sizeof(btree_link_t) * tree->order + tree->element_size * (tree->order - 1));
-	if(alloc == NULL)
-		return NULL;
+	if(tree->pool[kind] != NULL) { /* reuse a previously freed node */
+		alloc = tree->pool[kind];
+		tree->pool[kind] = tree->pool[kind]->parent;
+		tree->pool_size[kind]--;
+	}
+	else {
+		alloc = node_memory(tree, kind);
+		if(alloc == NULL)
+			return NULL;
+	}
+	memset(alloc, 0, node_size(tree, kind));
 	node = alloc;
-	node->links = alloc + sizeof(btree_node_t);
-	node->elements = alloc + sizeof(btree_node_t) + sizeof(btree_link_t) * tree->order;
+	if(kind == NODE_INTERIOR)
+		node->links = alloc + sizeof(btree_node_t);
+	if(!packs_leaves(tree) || kind == NODE_INTERIOR) /* packed leaves are unpacked on demand, see leaf_open() */
+		node->elements = alloc + tree->elements_offset[kind];
+	if(permutes(tree, node))
+		for(i = 0; i < tree->leaf_order - 1; i++)
+			node_perm(tree, node)[i] = i;
+	tree->nodes[kind]++;
 
 #ifdef TESTING
 	if(last_node_alloc != NULL)
@@ -158,8 +872,15 @@ static btree_node_t *alloc_node(
 }
 
 static void free_node(
+		btree_t *tree,
 		btree_node_t *node)
 {
+	int kind = node_kind(node);
+
+	if(node == &tree->small) { /* part of the tree structure */
+		node->fill = 0;
+		return;
+	}
 #ifdef TESTING
 	if(node->next_alloc != NULL)
 		node->next_alloc->prev_alloc = node->prev_alloc;
@@ -168,7 +889,42 @@ static void free_node(
 	else
 		node->prev_alloc->next_alloc = node->next_alloc;
 #endif
-	free(node);
+	if(packs_leaves(tree) && kind == NODE_LEAF)
+		leaf_discard(tree, node);
+	tree->nodes[kind]--;
+	if((tree->options & (BTREE_OPT_KEEP_NODES | BTREE_OPT_ARENA)) != 0 || tree->nodes[kind] + tree->pool_size[kind] < tree->reserve[kind]) {
+		node->parent = tree->pool[kind];
+		tree->pool[kind] = node;
+		tree->pool_size[kind]++;
+	}
+	else
+		node_memory_free(tree, kind, node);
+}
+
+/* free all nodes kept for reuse. arena nodes can only be released
+ * as a whole, i.e. when the tree does not use any nodes at all */
+static void drain_pool(
+		btree_t *tree)
+{
+	btree_node_t *next;
+	int kind;
+
+	if((tree->options & BTREE_OPT_ARENA) != 0) {
+		if(tree->nodes[NODE_LEAF] == 0 && tree->nodes[NODE_INTERIOR] == 0) {
+			arena_release(tree);
+			memset(tree->pool, 0, sizeof(tree->pool));
+			memset(tree->pool_size, 0, sizeof(tree->pool_size));
+		}
+		return;
+	}
+	for(kind = NODE_LEAF; kind <= NODE_INTERIOR; kind++) {
+		while(tree->pool[kind] != NULL) {
+			next = tree->pool[kind]->parent;
+			node_memory_free(tree, kind, tree->pool[kind]);
+			tree->pool[kind] = next;
+		}
+		tree->pool_size[kind] = 0;
+	}
 }
 
 static inline btree_node_t *left_sibling(
@@ -202,1092 +958,3717 @@ static inline bool overflowing(
 	return tree->overflow_node == node;
 }
 
+/* number of links of a node */
+static inline int node_order(
+		btree_t *tree,
+		btree_node_t *node)
+{
+	return isleaf(node) ? tree->leaf_order : tree->order;
+}
+
 static inline bool near_overflowing(
 		btree_t *tree,
 		btree_node_t *node)
 {
-	return node->fill == tree->order - 1;
+	return node->fill == node_order(tree, node) - 1;
 }
 
 static inline bool underflowing(
 		btree_t *tree,
 		btree_node_t *node)
 {
-	return node->fill < tree->order / 2;
+	return node->fill < node_order(tree, node) / 2;
 }
 
 static inline bool near_underflowing(
 		btree_t *tree,
 		btree_node_t *node)
 {
-	return node->fill == tree->order / 2;
+	return node->fill == node_order(tree, node) / 2;
 }
 
-static inline bool isleaf(
-		btree_node_t *node)
+/* the following link accessors treat a leaf node as if it had links
+ * without children, i.e. count 0 and offset equal to the link index */
+static inline btree_node_t *link_child(
+		btree_node_t *node,
+		btree_index_t i)
 {
-	return node->links[0].child == NULL;
+	return isleaf(node) ? NULL : node->links[i].child;
 }
 
-static int newroot(
-		btree_t *tree)
+static inline btree_index_t link_count(
+		btree_node_t *node,
+		btree_index_t i)
 {
-	btree_node_t *root = alloc_node(tree);
-	if(root == NULL)
-		return -ENOMEM;
-	if(tree->root != NULL) {
-		tree->root->parent = root;
-		tree->root->child_index = 0;
-		root->links[0].child = tree->root;
-		if(tree->overflow_node == tree->root)
-			root->links[0].count = tree->overflow_link.offset + tree->overflow_link.count;
+	return isleaf(node) ? 0 : node->links[i].count;
+}
+
+static inline btree_index_t link_offset(
+		btree_node_t *node,
+		btree_index_t i)
+{
+	return isleaf(node) ? i : node->links[i].offset;
+}
+
+/* number of elements within the subtree of 'node', including overflow */
+static btree_index_t subtree_size(
+		btree_t *tree,
+		btree_node_t *node)
+{
+	if(tree->overflow_node == node) {
+		if(isleaf(node))
+			return node->fill + 1;
 		else
-			root->links[0].count = tree->root->links[tree->root->fill].count + tree->root->links[tree->root->fill].offset;
+			return tree->overflow_link.offset + tree->overflow_link.count;
 	}
-	tree->root = root;
-	return 0;
+	else if(isleaf(node))
+		return node->fill;
+	else
+		return node->links[node->fill].offset + node->links[node->fill].count;
 }
 
-/* does not split root node;
- * node must be overflowing */
-static int split(
+static inline void *node_cache(
 		btree_t *tree,
-		btree_node_t *l)
+		btree_node_t *node)
 {
-	btree_node_t *p;
-	btree_node_t *r;
-	btree_link_t *rlink;
-	int sidx = tree->order / 2;
-	int i;
-	int n;
+	assert(node != &tree->layout.root); /* the root of a static layout has no data besides its elements, see search_key_init() */
+	return (void*)node + tree->cache_offset[node_kind(node)];
+}
 
-	assert(l == tree->overflow_node);
-	assert(l != tree->root);
-	assert(l->fill == tree->order - 1);
+static inline int bytes_cmp(
+		const void *a,
+		size_t a_len,
+		const void *b,
+		size_t b_len)
+{
+	int cmp = MIN(a_len, b_len) == 0 ? 0 : memcmp(a, b, MIN(a_len, b_len));
 
-	p = l->parent;
- 	r = alloc_node(tree);
-	if(r == NULL)
-		return -ENOMEM;
+	if(cmp != 0)
+		return cmp;
+	return (a_len > b_len) - (a_len < b_len);
+}
 
-	r->parent = p;
-	r->child_index = l->child_index + 1;
-	r->fill = l->fill - sidx;
+/* BTREE_OPT_STRING_KEYS: compare function used for the tree */
+static int string_cmp(
+		btree_t *tree,
+		const void *a,
+		const void *b,
+		void *group)
+{
+	const void *a_bytes;
+	const void *b_bytes;
+	size_t a_len = tree->hook_string(tree, a, &a_bytes);
+	size_t b_len = tree->hook_string(tree, b, &b_bytes);
 
-	/* copy overflow data to back of right node */
-	memcpy(r->elements + (r->fill - 1) * tree->element_size, tree->overflow_element, tree->element_size); /* move overflow element to last position of right node */
-	memcpy(r->links + r->fill, &tree->overflow_link, sizeof(btree_link_t)); /* move overflow link to last position of right node */
+	(void)group;
+	return bytes_cmp(a_bytes, a_len, b_bytes, b_len);
+}
 
-	/* insert new right node into parent */
-	if(r->child_index == tree->order) { /* new right node will be in overflow position */
-		memcpy(tree->overflow_element, l->elements + sidx * tree->element_size, tree->element_size); /* move single element from left node to overflow */
-		rlink = &tree->overflow_link;
-		tree->overflow_node = p;
-	}
-	else {
-		if(p->fill == tree->order - 1) { /* parent will overflow, move last element to overflow position */
-			memcpy(tree->overflow_element, p->elements + (p->fill - 1) * tree->element_size, tree->element_size);
-			memcpy(&tree->overflow_link, p->links + p->fill, sizeof(btree_link_t));
-			if(tree->overflow_link.child != NULL)
-				tree->overflow_link.child->child_index = tree->order;
-			tree->overflow_node = p;
-			p->fill--;
-		}
-		else { /* parent will not overflow, clear overflow position */
-			memset(tree->overflow_element, 0, tree->element_size);
-			memset(&tree->overflow_link, 0, sizeof(btree_link_t));
-			tree->overflow_node = NULL;
-		}
-		memmove(p->elements + (l->child_index + 1) * tree->element_size, p->elements + l->child_index * tree->element_size, (p->fill - l->child_index) * tree->element_size); /* insert new element at l->child_index */
-		memmove(p->links + l->child_index + 2, p->links + l->child_index + 1, (p->fill - l->child_index) * sizeof(btree_link_t)); /* insert new link at l->child_index + 1 */
-		memcpy(p->elements + l->child_index * tree->element_size, l->elements + sidx * tree->element_size, tree->element_size); /* move single element from left node to parent */
-		rlink = p->links + r->child_index;
+/* BTREE_OPT_STRING_KEYS: key bytes of an element as it is stored */
+static inline size_t string_key(
+		btree_t *tree,
+		const void *element,
+		const uint8_t **bytes)
+{
+	const void *ptr;
+	size_t len = tree->hook_string(tree, GET_E(tree, element), &ptr);
 
-		p->fill++;
-	}
-	rlink->child = r;
+	*bytes = ptr;
+	return len;
+}
 
-	memcpy(r->elements, l->elements + (sidx + 1) * tree->element_size, (r->fill - 1) * tree->element_size); /* move all remaining elements except overflow element from left node to right node */
-	memcpy(r->links, l->links + sidx + 1, r->fill * sizeof(btree_link_t)); /* move links except overflow link from left node to right node */
-	memset(l->elements + sidx * tree->element_size, 0, r->fill * tree->element_size); /* clear moved elements in left node */
-	memset(l->links + sidx + 1, 0, r->fill * sizeof(btree_link_t)); /* clear moved links in left node */
-	l->fill = sidx;
-	for(i = l->child_index + 1; i <= p->fill; i++) /* update child indices in parent */
-		if(p->links[i].child != NULL)
-			p->links[i].child->child_index = i;
-	for(i = 0; i <= r->fill; i++) /* update links in right node */
-		if(r->links[i].child != NULL) {
-			r->links[i].child->parent = r;
-			r->links[i].child->child_index = i;
-		}
+/* BTREE_OPT_STRING_KEYS: length of the prefix common to the keys of two
+ * elements, at most 'max'. keys are sorted, the prefix common to the first
+ * and the last key of a node is common to all of its keys */
+static size_t string_common(
+		btree_t *tree,
+		const void *a,
+		const void *b,
+		size_t max)
+{
+	const uint8_t *a_bytes;
+	const uint8_t *b_bytes;
+	size_t n = MIN(MIN(string_key(tree, a, &a_bytes), string_key(tree, b, &b_bytes)), max);
+	size_t len = 0;
+
+	while(len < n && a_bytes[len] == b_bytes[len])
+		len++;
+	return len;
+}
 
+static void string_build(
+		btree_t *tree,
+		btree_node_t *node)
+{
+	string_head_t *head = node_cache(tree, node);
+	string_slot_t *slots = (void*)head + string_head_size(NODE_INTERIOR);
+	const uint8_t *bytes;
+	size_t len;
+	size_t n;
+	int i;
 
-	n = 0;
-	for(i = 0; i <= r->fill; i++) {
-		r->links[i].offset = n;
-		n += r->links[i].count + 1;
+	head->prefix_len = 0;
+	if(node->fill == 0)
+		return;
+	head->prefix_len = string_common(tree, node_element(tree, node, 0), node_element(tree, node, node->fill - 1), STRING_PREFIX);
+	string_key(tree, node_element(tree, node, 0), &bytes);
+	memcpy(head->prefix, bytes, head->prefix_len);
+
+	for(i = 0; i < node->fill; i++) {
+		len = string_key(tree, node_element(tree, node, i), &bytes);
+		n = MIN(len - head->prefix_len, STRING_WINDOW + 1);
+		slots[i].len = n;
+		memcpy(slots[i].bytes, bytes + head->prefix_len, MIN(n, STRING_WINDOW));
 	}
-	n--;
-	p->links[l->child_index].count -= n + 1; /* n elements go to right node, one element to parent node */
-	rlink->count = n;
-	rlink->offset = p->links[l->child_index].offset + p->links[l->child_index].count + 1;
-	return 0;
 }
 
-static void concatenate(
+/* BTREE_OPT_KEY_COLUMN: compare function used for the tree */
+static int column_cmp(
 		btree_t *tree,
-		btree_node_t *l)
+		const void *a,
+		const void *b,
+		void *group)
 {
-	btree_node_t *p;
-	btree_node_t *r;
+	return tree->hook_key_cmp(tree, a + tree->key_offset, b, group);
+}
+
+/* key of an element handed to functions taking whole elements, to be compared
+ * against elements of the tree. BTREE_OPT_KEY_COLUMN compares keys only */
+static inline const void *element_key(
+		btree_t *tree,
+		const void *element)
+{
+	if((tree->options & BTREE_OPT_KEY_COLUMN) != 0)
+		return element + tree->key_offset;
+	else
+		return element;
+}
+
+/* BTREE_OPT_KEY_COLUMN: copy the keys of all elements into a dense array */
+static void column_build(
+		btree_t *tree,
+		btree_node_t *node)
+{
+	void *column = node_cache(tree, node);
 	int i;
-	int n;
 
-	assert(tree->overflow_node == NULL);
-	assert(l->child_index < tree->order - 1);
+	for(i = 0; i < node->fill; i++)
+		memcpy(column + i * tree->key_size, GET_E(tree, node_element(tree, node, i)) + tree->key_offset, tree->key_size);
+}
 
-	p = l->parent;
-	r = p->links[l->child_index + 1].child;
+/* BTREE_OPT_KEY_PREFIX: copy the key prefixes of all elements into a dense array */
+static void prefix_build(
+		btree_t *tree,
+		btree_node_t *node)
+{
+	uint64_t *prefixes = node_cache(tree, node);
+	int i;
 
-	assert(l->fill + 1 + r->fill <= tree->order);
+	for(i = 0; i < node->fill; i++)
+		prefixes[i] = tree->hook_prefix(tree, GET_E(tree, node_element(tree, node, i)));
+}
 
-	if(l->fill + 1 + r->fill == tree->order) { /* left element will overflow */
-		memcpy(tree->overflow_element, r->elements + (r->fill - 1) * tree->element_size, tree->element_size); /* move last element of right node into overflow position */
-		memcpy(&tree->overflow_link, r->links + r->fill, sizeof(btree_link_t)); /* move last link of right node into overflow position */
-		if(tree->overflow_link.child != NULL) {
-			tree->overflow_link.child->parent = l;
-			tree->overflow_link.child->child_index = tree->order;
-		}
-		tree->overflow_node = l;
-		r->fill--;
+/* built-in keys: the key of an element, mapped to a signed integer of the same order */
+static inline int64_t int_key(
+		btree_t *tree,
+		const void *element)
+{
+	int32_t key32;
+	int64_t key;
+
+	if(tree->key_type == BTREE_KEY_INT32) {
+		memcpy(&key32, element + tree->key_offset, sizeof(key32));
+		return key32;
 	}
-	memcpy(l->elements + l->fill * tree->element_size, p->elements + l->child_index * tree->element_size, tree->element_size); /* append element from parent to left node */
-	memcpy(l->elements + (l->fill + 1) * tree->element_size, r->elements, r->fill * tree->element_size); /* append elements except overflow from right node to left node */
-	memcpy(l->links + l->fill + 1, r->links, (r->fill + 1) * sizeof(btree_link_t)); /* append links except overflow from right node to left node */
-	l->fill += 1 + r->fill;
+	memcpy(&key, element + tree->key_offset, sizeof(key));
+	if(tree->key_type == BTREE_KEY_UINT64)
+		key = (int64_t)((uint64_t)key ^ ((uint64_t)1 << 63));
+	return key;
+}
 
-	p->fill--;
-	memmove(p->elements + l->child_index * tree->element_size, p->elements + (l->child_index + 1) * tree->element_size, (p->fill - l->child_index) * tree->element_size); /* delete element from parent */
-	memmove(p->links + l->child_index + 1, p->links + l->child_index + 2, (p->fill - l->child_index) * sizeof(btree_link_t)); /* delete link from parent */
-	memset(p->elements + p->fill * tree->element_size, 0, tree->element_size); /* clear last element from parent */
-	memset(p->links + p->fill + 1, 0, sizeof(btree_link_t)); /* clear last link from parent */
-	for(i = l->fill - r->fill; i <= l->fill; i++)
-		if(l->links[i].child != NULL) {
-			l->links[i].child->parent = l;
-			l->links[i].child->child_index = i;
-		}
-	for(i = l->child_index + 1; i <= p->fill; i++)
-		if(p->links[i].child != NULL)
-			p->links[i].child->child_index = i;
+/* built-in keys: compare function used for the tree */
+static int int_cmp(
+		btree_t *tree,
+		const void *a,
+		const void *b,
+		void *group)
+{
+	int64_t ka = int_key(tree, a);
+	int64_t kb = int_key(tree, b);
+
+	(void)group;
+	return (ka > kb) - (ka < kb);
+}
+
+/* built-in keys: copy the keys of all elements into a dense array, as returned by int_key() */
+static void int_build(
+		btree_t *tree,
+		btree_node_t *node)
+{
+	void *keys = node_cache(tree, node);
+	int i;
+
+	for(i = 0; i < node->fill; i++)
+		if(tree->key_type == BTREE_KEY_INT32)
+			((int32_t*)keys)[i] = int_key(tree, GET_E(tree, node_element(tree, node, i)));
+		else
+			((int64_t*)keys)[i] = int_key(tree, GET_E(tree, node_element(tree, node, i)));
+}
 
-	free_node(r);
+/* search kernels for built-in keys, see int_count_t. the vector kernels
+ * read whole vectors, the keys are padded accordingly (INT_VECTOR) */
+static int int32_count(
+		const void *keys,
+		int n,
+		int64_t key,
+		bool upper)
+{
+	const int32_t *k = keys;
+	int l = 0;
+	int u = n;
+	int m;
 
-	n = 0;
-	for(i = 0; i <= l->fill; i++) {
-		l->links[i].offset = n;
-		n += l->links[i].count + 1;
+	while(l < u) {
+		m = l + (u - l) / 2;
+		if(k[m] > key || (k[m] == key && !upper))
+			u = m;
+		else
+			l = m + 1;
 	}
-	n--;
-	if(tree->overflow_node == l) {
-		n++;
-		tree->overflow_link.offset = n;
-		n += tree->overflow_link.count;
+	return l;
+}
+
+static int int64_count(
+		const void *keys,
+		int n,
+		int64_t key,
+		bool upper)
+{
+	const int64_t *k = keys;
+	int l = 0;
+	int u = n;
+	int m;
+
+	while(l < u) {
+		m = l + (u - l) / 2;
+		if(k[m] > key || (k[m] == key && !upper))
+			u = m;
+		else
+			l = m + 1;
 	}
-	p->links[l->child_index].count = n;
+	return l;
 }
 
-/* move last element of node 'l' to parent;
- * move element at corresponding parent position to beginning of right sibling
- * note: right sibling must not be full */
-static void lr_redistribute(
-		btree_t *tree,
-		btree_node_t *l)
+#ifdef SIMD_X86
+/* the lanes of a vector holding a key which is counted form a prefix, as the
+ * keys are sorted. counting stops with the first vector not counted as a whole */
+__attribute__((target("sse2")))
+static int int32_count_sse2(
+		const void *keys,
+		int n,
+		int64_t key,
+		bool upper)
 {
-	btree_node_t *p;
-	btree_node_t *r;
+	__m128i k = _mm_set1_epi32(key);
+	__m128i v;
+	int count = 0;
+	int mask;
 	int i;
-	int n;
 
-	assert(l == tree->overflow_node || tree->overflow_node == NULL);
-	assert(l != tree->root);
-	assert(l->child_index < tree->order - 1);
+	for(i = 0; i < n; i += 4) {
+		v = _mm_loadu_si128(keys + i * sizeof(int32_t));
+		if(upper)
+			mask = ~_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(v, k))) & 0xf;
+		else
+			mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(k, v)));
+		count += __builtin_popcount(n - i < 4 ? mask & ((1 << (n - i)) - 1) : mask);
+		if(mask != 0xf)
+			break;
+	}
+	return count;
+}
 
-	p = l->parent;
-	r = p->links[l->child_index + 1].child;
+__attribute__((target("avx2")))
+static int int32_count_avx2(
+		const void *keys,
+		int n,
+		int64_t key,
+		bool upper)
+{
+	__m256i k = _mm256_set1_epi32(key);
+	__m256i v;
+	int count = 0;
+	int mask;
+	int i;
 
-	assert(r->fill < tree->order - 1);
+	for(i = 0; i < n; i += 8) {
+		v = _mm256_loadu_si256(keys + i * sizeof(int32_t));
+		if(upper)
+			mask = ~_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(v, k))) & 0xff;
+		else
+			mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(k, v)));
+		count += __builtin_popcount(n - i < 8 ? mask & ((1 << (n - i)) - 1) : mask);
+		if(mask != 0xff)
+			break;
+	}
+	return count;
+}
 
-	memmove(r->elements + tree->element_size, r->elements, r->fill * tree->element_size); /* insert new first element at right node */
-	memmove(r->links + 1, r->links, (r->fill + 1) * sizeof(btree_link_t)); /* insert new link at right node */
-	memcpy(r->elements, p->elements + l->child_index * tree->element_size, tree->element_size); /* move element from parent to first position at right node */
-	if(l == tree->overflow_node) {
-		memcpy(p->elements + l->child_index * tree->element_size, tree->overflow_element, tree->element_size); /* move overflow element from left node to parent */
-		memcpy(r->links, &tree->overflow_link, sizeof(btree_link_t)); /* move overflow link from left node to first link of right node */
-		memset(tree->overflow_element, 0, tree->element_size); /* clear overflow element */
-		memset(&tree->overflow_link, 0, sizeof(btree_link_t)); /* clear overflow link */
-		tree->overflow_node = NULL;
+__attribute__((target("sse4.2")))
+static int int64_count_sse42(
+		const void *keys,
+		int n,
+		int64_t key,
+		bool upper)
+{
+	__m128i k = _mm_set1_epi64x(key);
+	__m128i v;
+	int count = 0;
+	int mask;
+	int i;
+
+	for(i = 0; i < n; i += 2) {
+		v = _mm_loadu_si128(keys + i * sizeof(int64_t));
+		if(upper)
+			mask = ~_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(v, k))) & 0x3;
+		else
+			mask = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(k, v)));
+		count += __builtin_popcount(n - i < 2 ? mask & 0x1 : mask);
+		if(mask != 0x3)
+			break;
 	}
-	else {
-		memcpy(p->elements + l->child_index * tree->element_size, l->elements + (l->fill - 1) * tree->element_size, tree->element_size); /* move last element from left node to parent */
-		memcpy(r->links, l->links + l->fill, sizeof(btree_link_t)); /* move last link from left node to first link of right node */
-		memset(l->elements + (l->fill - 1) * tree->element_size, 0, tree->element_size); /* clear last element from left node */
-		memset(l->links + l->fill, 0, sizeof(btree_link_t)); /* clear last link of left node */
-		l->fill--;
+	return count;
+}
+
+__attribute__((target("avx2")))
+static int int64_count_avx2(
+		const void *keys,
+		int n,
+		int64_t key,
+		bool upper)
+{
+	__m256i k = _mm256_set1_epi64x(key);
+	__m256i v;
+	int count = 0;
+	int mask;
+	int i;
+
+	for(i = 0; i < n; i += 4) {
+		v = _mm256_loadu_si256(keys + i * sizeof(int64_t));
+		if(upper)
+			mask = ~_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(v, k))) & 0xf;
+		else
+			mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(k, v)));
+		count += __builtin_popcount(n - i < 4 ? mask & ((1 << (n - i)) - 1) : mask);
+		if(mask != 0xf)
+			break;
 	}
-	r->fill++;
+	return count;
+}
+#endif
 
-	if(r->links[0].child != NULL)
-		r->links[0].child->parent = r;
-	for(i = 0; i <= r->fill; i++)
-		if(r->links[i].child != NULL)
-			r->links[i].child->child_index = i;
+/* the fastest search kernel the CPU supports for a key type */
+static int_count_t int_kernel(
+		int key_type)
+{
+	if(key_type == BTREE_KEY_INT32) {
+#ifdef SIMD_X86
+		if(__builtin_cpu_supports("avx2"))
+			return int32_count_avx2;
+		else if(__builtin_cpu_supports("sse2"))
+			return int32_count_sse2;
+#endif
+		return int32_count;
+	}
+#ifdef SIMD_X86
+	if(__builtin_cpu_supports("avx2"))
+		return int64_count_avx2;
+	else if(__builtin_cpu_supports("sse4.2"))
+		return int64_count_sse42;
+#endif
+	return int64_count;
+}
 
-	n = r->links[0].count + 1; /* number of elements moved from left to right... */
-	p->links[l->child_index].count -= n; /* ...which are missing on left node now */
-	p->links[r->child_index].count += n; /* ...are present on right node now */
-	p->links[r->child_index].offset -= n; /* ...which shift the offset of the right node */
-	r->links[0].offset = 0;
-	for(i = 1; i <= r->fill; i++)
-		r->links[i].offset += n; /* ...and the offset of all consecutive links on right node */
+/* BTREE_OPT_PACKED_LEAVES: the key of an element */
+static inline int64_t packed_key(
+		const void *element)
+{
+	int64_t key;
+
+	memcpy(&key, element, sizeof(key));
+	return key;
 }
 
-/* move first element of node 'r' to parent;
- * move element at corresponding parent position to first free of left sibling
- * note: left sibling must not be full */
-static void rl_redistribute(
+/* BTREE_OPT_PACKED_LEAVES: compare function used for the tree */
+static int packed_cmp(
 		btree_t *tree,
-		btree_node_t *r)
+		const void *a,
+		const void *b,
+		void *group)
 {
-	btree_node_t *p;
-	btree_node_t *l;
-	int i;
-	int n;
+	int64_t a_key = packed_key(a);
+	int64_t b_key = packed_key(b);
 
-	assert(r == tree->overflow_node || tree->overflow_node == NULL);
-	assert(r != tree->root);
-	assert(r->child_index > 0);
+	(void)tree;
+	(void)group;
+	return (a_key > b_key) - (a_key < b_key);
+}
 
-	p = r->parent;
-	l = p->links[r->child_index - 1].child;
+/* deltas are packed in little endian order, so that the bits of a delta are contiguous */
+static inline uint64_t load_le64(
+		const void *ptr)
+{
+	uint64_t value;
 
-	assert(l->fill < tree->order - 1);
+	memcpy(&value, ptr, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	value = __builtin_bswap64(value);
+#endif
+	return value;
+}
 
-	memcpy(l->elements + l->fill * tree->element_size, p->elements + l->child_index * tree->element_size, tree->element_size); /* move element from parent to last position at left node */
-	memcpy(p->elements + l->child_index * tree->element_size, r->elements, tree->element_size); /* move first element from right node to parent */
-	memcpy(l->links + l->fill + 1, r->links, sizeof(btree_link_t)); /* move first link from right node to left node */
-	memmove(r->elements, r->elements + tree->element_size, (r->fill - 1) * tree->element_size); /* delete first element at right node */
-	memmove(r->links, r->links + 1, r->fill * sizeof(btree_link_t)); /* delete first link at right node */
-	l->fill++;
-	if(tree->overflow_node == r) {
-		memmove(r->elements + (r->fill - 1) * tree->element_size, tree->overflow_element, tree->element_size);
-		memmove(r->links + r->fill, &tree->overflow_link, sizeof(btree_link_t));
-		memset(tree->overflow_element, 0, tree->element_size); /* clear overflow element */
-		memset(&tree->overflow_link, 0, sizeof(btree_link_t)); /* clear overflow link */
-		tree->overflow_node = NULL;
-	}
-	else {
-		memset(r->elements + (r->fill - 1) * tree->element_size, 0, tree->element_size); /* clear last element from right node */
-		memset(r->links + r->fill, 0, sizeof(btree_link_t)); /* clear last link from right node */
-		r->fill--;
-	}
+static inline void store_le64(
+		void *ptr,
+		uint64_t value)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	value = __builtin_bswap64(value);
+#endif
+	memcpy(ptr, &value, sizeof(value));
+}
 
-	for(i = 0; i <= r->fill; i++)
-		if(r->links[i].child != NULL)
-			r->links[i].child->child_index = i;
+static inline uint64_t packed_delta(
+		const packed_leaf_t *packed,
+		int i)
+{
+	size_t offset = (size_t)i * packed->width;
 
-	n = l->links[l->fill].count + 1;
-	p->links[l->child_index].count += n;
-	p->links[r->child_index].count -= n;
-	p->links[r->child_index].offset += n;
-	if(l->fill == 0)
-		l->links[0].offset = 0;
+	if(packed->width == 0)
+		return 0;
+	else if(packed->width == 64)
+		return load_le64(packed->block + offset / 8);
 	else
-		l->links[l->fill].offset = l->links[l->fill - 1].offset + l->links[l->fill - 1].count + 1;
-	if(l->links[l->fill].child != NULL) {
-		l->links[l->fill].child->parent = l;
-		l->links[l->fill].child->child_index = l->fill;
-	}
-	for(i = 0; i <= r->fill; i++)
-		r->links[i].offset -= n;
+		return (load_le64(packed->block + offset / 8) >> (offset % 8)) & (((uint64_t)1 << packed->width) - 1);
 }
 
-static int adjust(
-		btree_t *tree,
-		btree_node_t *node)
+/* the remaining bytes of all elements follow the deltas */
+static inline void *packed_payload(
+		const packed_leaf_t *packed,
+		int fill)
 {
-	int ret = 0;
-	btree_node_t *left;
-	btree_node_t *right;
-	if(overflowing(tree, node)) {
-		left = left_sibling(tree, node);
-		right = right_sibling(tree, node);
-		if(right != NULL && !near_overflowing(tree, right)) /* test: overflow_1 */
-			lr_redistribute(tree, node);
-		else if(left != NULL && !near_overflowing(tree, left)) /* test: overflow_2 */
-			rl_redistribute(tree, node);
-		else if(node->parent == NULL) { /* test: overflow_3 */
-			ret = newroot(tree);
-			if(ret == 0)
-				ret = split(tree, node);
-		}
-		else { /* test: overflow_4 */
-			ret = split(tree, node);
-			if(ret == 0)
-				ret = adjust(tree, node->parent);
-		}
-	}
-	else if(underflowing(tree, node)) {
-		left = left_sibling(tree, node);
-		right = right_sibling(tree, node);
-		if(left != NULL && !near_underflowing(tree, left)) /* test: underflow_1 */
-			lr_redistribute(tree, left);
-		else if(right != NULL && !near_underflowing(tree, right)) /* test: underflow_2 */
-			rl_redistribute(tree, right);
-		else if(node->parent == NULL) {
-			if(node->fill == 0) { /* test: underflow_3 */
-				tree->root = node->links[0].child;
-				tree->root->parent = NULL;
-				free_node(node);
-			}
-		}
-		else if(right != NULL) { /* test: underflow_4 */
-			concatenate(tree, node);
-			adjust(tree, node->parent);
-		}
-		else { /* 'left' must exist */
-			concatenate(tree, left);
-			adjust(tree, left->parent);
-		}
-	}
-	return ret;
+	return packed->block + ((size_t)fill * packed->width + 7) / 8 + PACKED_SLACK;
 }
 
-static void update_count(
-		btree_node_t *node,
-		int amount)
+/* size of the unpacked elements of a leaf */
+static inline size_t unpacked_size(
+		btree_t *tree)
 {
-	int i;
-	int ci;
-	while(node->parent != NULL) {
-		ci = node->child_index;
-		node = node->parent;
-		node->links[ci].count += amount;
-		for(i = ci + 1; i <= node->fill; i++)
-			node->links[i].offset += amount;
-	}
+	return (size_t)tree->element_size * (tree->leaf_order - 1);
 }
 
-static int node_insert(
+/* BTREE_OPT_DUP_RUNS: the keys of all runs follow the run ends */
+static inline void *runs_keys(
+		const packed_leaf_t *packed)
+{
+	return packed->block + packed->runs * sizeof(uint16_t);
+}
+
+/* BTREE_OPT_DUP_RUNS: the remaining bytes of all elements follow the keys */
+static inline void *runs_payload(
 		btree_t *tree,
-		btree_node_t *node,
-		int pos,
+		const packed_leaf_t *packed)
+{
+	return runs_keys(packed) + packed->runs * tree->key_size;
+}
+
+/* BTREE_OPT_DUP_RUNS: decode element 'i' of a packed leaf */
+static void runs_get(
+		btree_t *tree,
+		const packed_leaf_t *packed,
+		int i,
 		void *element)
 {
-	int ret;
+	const uint16_t *ends = packed->block;
+	size_t payload = tree->element_size - tree->key_size;
+	const void *src = runs_payload(tree, packed) + i * payload;
+	int l = 0;
+	int u = packed->runs - 1;
+	int m;
 
-	if(tree->root == NULL) {
-		ret = newroot(tree);
-		if(ret != 0)
-			return ret;
-	}
-	if(node == NULL) {
-		node = tree->root;
-		pos = 0;
-	}
-	if(pos == tree->order - 1) { /* put new element into overflow position */
-		if(element == NULL)
-			CLEAR_EP(tree, tree->overflow_element);
-		else
-			SET_EP(tree, tree->overflow_element, element);
-		tree->overflow_node = node;
-	}
-	else {
-		if(node->fill == tree->order - 1) { /* node will overflow, move last element to overflow position */
-			memcpy(tree->overflow_element, node->elements + (node->fill - 1) * tree->element_size, tree->element_size);
-			tree->overflow_node = node;
-			node->fill--;
-		}
-		memmove(node->elements + (pos + 1) * tree->element_size, node->elements + pos * tree->element_size, (node->fill - pos) * tree->element_size);
-		if(element == NULL)
-			CLEAR_EP(tree, node->elements + pos * tree->element_size);
+	while(l < u) { /* first run ending after 'i' */
+		m = l + (u - l) / 2;
+		if(ends[m] > i)
+			u = m;
 		else
-			SET_EP(tree, node->elements + pos * tree->element_size, element);
-		node->fill++;
+			l = m + 1;
 	}
-	if(tree->overflow_node == node)
-		tree->overflow_link.offset = node->fill + 1;
-	else
-		node->links[node->fill].offset = node->fill;
+	memcpy(element, src, tree->key_offset);
+	memcpy(element + tree->key_offset, runs_keys(packed) + l * tree->key_size, tree->key_size);
+	memcpy(element + tree->key_offset + tree->key_size, src + tree->key_offset, payload - tree->key_offset);
+}
 
-	update_count(node, 1);
-	ret = adjust(tree, node);
-	if(ret != 0)
-		return ret;
-	if(tree->hook_acquire != NULL && element != NULL)
-		tree->hook_acquire(tree, element);
-	return 0;
+/* BTREE_OPT_VAR_ELEMENTS: element 'i' of a packed leaf as it is stored */
+static inline void *var_element(
+		const packed_leaf_t *packed,
+		int i,
+		size_t *len)
+{
+	const page_slot_t *slot = (const page_slot_t*)packed->block + i;
+
+	*len = slot->length;
+	return packed->block + slot->offset;
 }
 
-static int node_replace(
+/* decode element 'i' of a packed leaf */
+static void packed_get(
 		btree_t *tree,
 		btree_node_t *node,
-		int pos,
+		int i,
 		void *element)
 {
-	if(tree->hook_release != NULL)
-		tree->hook_release(tree, GET_E(tree, node->elements + pos * tree->element_size));
-	if(element == NULL)
-		CLEAR_EP(tree, node->elements + pos * tree->element_size);
+	const packed_leaf_t *packed = node_cache(tree, node);
+	size_t payload = tree->element_size - sizeof(int64_t);
+	int64_t key;
+	const void *var;
+	size_t len;
+
+	if((tree->options & BTREE_OPT_DUP_RUNS) != 0) {
+		runs_get(tree, packed, i, element);
+		return;
+	}
+	else if((tree->options & BTREE_OPT_VAR_ELEMENTS) != 0) {
+		var = var_element(packed, i, &len);
+		memcpy(element, var, len);
+		memset(element + len, 0, tree->element_size - len);
+		return;
+	}
+	key = (uint64_t)packed->base + packed_delta(packed, i);
+	memcpy(element, &key, sizeof(key));
+	memcpy(element + sizeof(key), packed_payload(packed, node->fill) + i * payload, payload);
+}
+
+/* copy element 'i' of a leaf, whether it is packed or not */
+static inline void leaf_get(
+		btree_t *tree,
+		btree_node_t *node,
+		int i,
+		void *element)
+{
+	if(node->elements == NULL)
+		packed_get(tree, node, i, element);
 	else
-		SET_EP(tree, node->elements + pos * tree->element_size, element);
-	if(tree->hook_acquire != NULL && element != NULL)
-		tree->hook_acquire(tree, element);
+		memcpy(element, node->elements + i * tree->element_size, tree->element_size);
+}
+
+/* resize the block of a packed leaf, its contents are undefined afterwards */
+static int packed_resize(
+		btree_t *tree,
+		packed_leaf_t *packed,
+		size_t size)
+{
+	void *block = NULL;
+
+	if(size == packed->block_size)
+		return 0;
+	if(size > 0) {
+		block = tree->allocator.alloc(size, MAX(sizeof(uint64_t), tree->element_align), tree->allocator.context);
+		if(block == NULL)
+			return -ENOMEM;
+	}
+	if(packed->block != NULL)
+		tree->allocator.free(packed->block, packed->block_size, tree->allocator.context);
+	tree->packed.block_bytes += size - packed->block_size;
+	packed->block = block;
+	packed->block_size = size;
 	return 0;
 }
 
-/* TODO casual segfault when removing items from an even-order btree */
-static int node_remove(
+/* BTREE_OPT_DUP_RUNS: encode the unpacked elements of a leaf as runs of equal key bytes */
+static int runs_pack(
 		btree_t *tree,
-		btree_node_t *node,
-		int pos)
+		btree_node_t *node)
 {
-	btree_node_t *cur;
+	packed_leaf_t *packed = node_cache(tree, node);
+	size_t payload = tree->element_size - tree->key_size;
+	uint16_t *ends;
+	void *element;
+	void *dst;
+	int runs = 0;
+	int i;
+	int ret;
 
-	if(tree->hook_release != NULL)
-		tree->hook_release(tree, GET_E(tree, node->elements + pos * tree->element_size));
-	if(isleaf(node)) { /* node where the element is contained within is a leaf, simply remove it */
-		node->fill--;
-		memmove(node->elements + pos * tree->element_size, node->elements + (pos + 1) * tree->element_size, (node->fill - pos) * tree->element_size);
-		if(node == tree->root && node->fill == 0) {
-			free_node(node);
-			tree->root = NULL;
-			return 0;
+	for(i = 0; i < node->fill; i++)
+		if(i == 0 || memcmp(node->elements + i * tree->element_size + tree->key_offset, node->elements + (i - 1) * tree->element_size + tree->key_offset, tree->key_size) != 0)
+			runs++;
+	ret = packed_resize(tree, packed, node->fill == 0 ? 0 : runs * (sizeof(uint16_t) + tree->key_size) + node->fill * payload);
+	if(ret != 0)
+		return ret;
+	packed->runs = runs;
+	packed->dirty = false;
+
+	ends = packed->block;
+	runs = 0;
+	for(i = 0; i < node->fill; i++) {
+		element = node->elements + i * tree->element_size;
+		if(i == 0 || memcmp(element + tree->key_offset, element - tree->element_size + tree->key_offset, tree->key_size) != 0) { /* a new run starts */
+			if(i > 0)
+				ends[runs++] = i;
+			memcpy(runs_keys(packed) + runs * tree->key_size, element + tree->key_offset, tree->key_size);
 		}
+		dst = runs_payload(tree, packed) + i * payload;
+		memcpy(dst, element, tree->key_offset);
+		memcpy(dst + tree->key_offset, element + tree->key_offset + tree->key_size, payload - tree->key_offset);
 	}
-	else { /* node where the element is contained within is not a leaf, search cur leaf of right subtree */
-		cur = node->links[pos + 1].child;
-		while(!isleaf(cur))
-			cur = cur->links[0].child;
-		memcpy(node->elements + pos * tree->element_size, cur->elements, tree->element_size); /* move first element to position of deleted element */
-		cur->fill--;
-		memmove(cur->elements, cur->elements + tree->element_size, cur->fill * tree->element_size); /* delete moved element */
-		node = cur;
-	}
-	update_count(node, -1);
-	return adjust(tree, node);
+	if(node->fill > 0)
+		ends[runs] = node->fill;
+	return 0;
 }
 
-/* converts a node and a position to a position on a leaf, where
- * a new element can be inserted, so that the resulting element
- * will be located immediately before the given element */
-static void to_insert_before(
+/* BTREE_OPT_VAR_ELEMENTS: length of an unpacked element */
+static inline size_t var_length(
 		btree_t *tree,
-		btree_node_t **node,
-		int *pos)
+		const void *element)
 {
-	if(*node == NULL) { /* rightmost position in tree; find_lower returns NULL is all elements are less, therefore insertion would take place at rightmost slot */
-		if(tree->root == NULL) /* no root node yet, *node remains NULL */
-			return;
-		*node = tree->root;
-		*pos = tree->root->fill;
-	}
-	while(!isleaf(*node)) {
-		*node = (*node)->links[*pos].child;
-		*pos = (*node)->fill;
-	}
+	return MIN(tree->hook_length(tree, element), (size_t)tree->element_size);
 }
 
-/* converts a node and a position to a position on a leaf, where
- * a new element can be inserted, so that the resulting element
- * will be located immediately after the given element */
-/*static void to_insert_after(
+/* BTREE_OPT_STRING_KEYS: key bytes following the common prefix a leaf page
+ * keeps per key at most, so that every page holds PAGE_MIN_ELEMENTS keys */
+static inline size_t page_window(
+		btree_t *tree)
+{
+	return tree->leaf_bytes / PAGE_MIN_ELEMENTS - sizeof(page_slot_t);
+}
+
+/* bytes an element takes within a leaf page at most */
+static inline size_t page_record_max(
+		btree_t *tree)
+{
+	if((tree->options & BTREE_OPT_STRING_KEYS) != 0)
+		return sizeof(page_slot_t) + page_window(tree);
+	return sizeof(page_slot_t) + tree->element_size;
+}
+
+/* BTREE_OPT_STRING_KEYS: length of the prefix a leaf page ranging from
+ * element 'first' to element 'last' keeps once for all keys */
+static inline size_t page_prefix(
 		btree_t *tree,
-		btree_node_t **node,
-		int *pos)
+		const void *first,
+		const void *last)
 {
-	if(*node == NULL) {
-		if(tree->root == NULL)
-			return;
-		*node = tree->root;
-		*pos = -1;
-	}
-	while(!isleaf(*node)) {
-		*node = (*node)->links[*pos + 1].child;
-		*pos = -1;
-	}
-	(*pos)++;
-}*/
+	if((tree->options & BTREE_OPT_STRING_KEYS) != 0)
+		return string_common(tree, first, last, STRING_LEAF_PREFIX);
+	return 0;
+}
 
-static int subtree_pos(
+/* bytes an element takes within a leaf page, its slot included.
+ * BTREE_OPT_STRING_KEYS: the key bytes following 'prefix' */
+static inline size_t page_record(
+		btree_t *tree,
+		const void *element,
+		size_t prefix)
+{
+	const uint8_t *bytes;
+
+	if((tree->options & BTREE_OPT_STRING_KEYS) != 0)
+		return sizeof(page_slot_t) + MIN(string_key(tree, element, &bytes) - prefix, page_window(tree));
+	return sizeof(page_slot_t) + ALIGN_UP(var_length(tree, element), tree->element_align);
+}
+
+/* bytes the unpacked elements [first, first + n) of a leaf take within its page */
+static size_t page_bytes(
+		btree_t *tree,
 		btree_node_t *node,
-		int index)
+		int first,
+		int n)
 {
-	int l = 0;
-	int u = node->fill;
-	int o;
-	int c;
-	int m;
+	size_t prefix = n == 0 ? 0 : page_prefix(tree, node->elements + first * tree->element_size, node->elements + (first + n - 1) * tree->element_size);
+	size_t bytes = 0;
+	int i;
 
-	while(l <= u) {
-		m = l + (u - l) / 2;
-		c = node->links[m].count;
-		o = node->links[m].offset;
-		if(o > index)
-			u = m - 1;
-		else if(o + c < index)
-			l = m + 1;
-		else
-			return m;
-	}
-	return -1;
+	for(i = first; i < first + n; i++)
+		bytes += page_record(tree, node->elements + i * tree->element_size, prefix);
+	return bytes;
 }
 
-static bool find_lower(
+/* BTREE_OPT_STRING_KEYS: write the keys of a leaf into its page; the common
+ * prefix into the head, the slots from the start of the page and the bytes
+ * following the prefix (at most page_window()) from its end. keys of a leaf
+ * exceeding its page are not written completely, it is split right after,
+ * see page_adjust(); until then searches compare the elements */
+static void string_page(
 		btree_t *tree,
-		const void *key,
-		btree_node_t **node,
-		int *pos,
-		void *group,
-		btree_cmp_t cmpfn)
+		btree_node_t *node)
 {
-	int u;
-	int l;
-	int m;
-	int cmp;
-	btree_node_t *node_candidate = NULL;
-	int pos_candidate = 0;
-	bool found = false;
-	btree_node_t *cur = tree->root;
-	btree_node_t *prev = NULL;
+	string_head_t *head = node_cache(tree, node);
+	page_slot_t *slots = (void*)head + string_head_size(NODE_LEAF);
+	const uint8_t *bytes;
+	size_t end = tree->leaf_bytes;
+	size_t len;
+	int i;
 
-	while(cur != NULL) {
-		u = cur->fill - 1;
-		l = 0;
-		prev = cur;
-		while(l <= u) {
-			m = l + (u - l) / 2;
-			cmp = cmpfn(tree, GET_E(tree, cur->elements + m * tree->element_size), key, group);
-			if(cmp >= 0) {
-				node_candidate = cur;
-				pos_candidate = m;
-				u = m - 1;
-				if(cmp == 0)
-					found = true;
-			}
-			else
-				l = m + 1;
+	head->prefix_len = 0;
+	head->end = end;
+	if(node->fill == 0)
+		return;
+	head->prefix_len = page_prefix(tree, node->elements, node->elements + (node->fill - 1) * tree->element_size);
+	string_key(tree, node->elements, &bytes);
+	memcpy(head->prefix, bytes, head->prefix_len);
+
+	for(i = 0; i < node->fill; i++) {
+		len = string_key(tree, node->elements + i * tree->element_size, &bytes) - head->prefix_len;
+		if(end < (i + 1) * sizeof(page_slot_t) + MIN(len, page_window(tree))) {
+			head->prefix_len = STRING_STALE;
+			return;
 		}
-		cur = cur->links[l].child;
+		slots[i].length = MIN(len, page_window(tree) + 1);
+		len = MIN(len, page_window(tree));
+		end -= len;
+		memcpy((uint8_t*)slots + end, bytes + head->prefix_len, len);
+		slots[i].offset = end;
 	}
+	head->end = end;
+}
 
-	if(node_candidate == NULL && prev != NULL) { /* all element keys less than requested key, select imaginary element after end (rightmost leaf node) */
-		node_candidate = prev;
-		pos_candidate = prev->fill;
+/* BTREE_OPT_STRING_KEYS: string_page() for a single key inserted at 'pos',
+ * which only dereferences the new element as long as the common prefix
+ * remains and the free bytes between the slots and the key bytes suffice.
+ * the key bytes of removed elements are only reclaimed by string_page() */
+static void string_page_insert(
+		btree_t *tree,
+		btree_node_t *node,
+		int pos)
+{
+	string_head_t *head = node_cache(tree, node);
+	page_slot_t *slots = (void*)head + string_head_size(NODE_LEAF);
+	const uint8_t *bytes;
+	size_t len;
+
+	if(head->prefix_len == STRING_STALE || node->fill == 1 || tree->overflow_node == node) { /* an overflowing leaf is split right after */
+		string_page(tree, node);
+		return;
 	}
-	if(node != NULL)
-		*node = node_candidate;
-	if(pos != NULL)
-		*pos = pos_candidate;
-	return found;
+	else if((pos == 0 || pos == node->fill - 1) && page_prefix(tree, node->elements, node->elements + (node->fill - 1) * tree->element_size) != head->prefix_len) {
+		string_page(tree, node);
+		return;
+	}
+	len = string_key(tree, node->elements + pos * tree->element_size, &bytes) - head->prefix_len;
+	if(head->end < node->fill * sizeof(page_slot_t) + MIN(len, page_window(tree))) {
+		string_page(tree, node);
+		return;
+	}
+	memmove(slots + pos + 1, slots + pos, (node->fill - 1 - pos) * sizeof(page_slot_t));
+	slots[pos].length = MIN(len, page_window(tree) + 1);
+	len = MIN(len, page_window(tree));
+	head->end -= len;
+	memcpy((uint8_t*)slots + head->end, bytes + head->prefix_len, len);
+	slots[pos].offset = head->end;
 }
 
-static bool find_lower_in(
+/* bytes a leaf takes within its page. BTREE_OPT_STRING_KEYS: read from
+ * the slots, so that the elements aren't dereferenced, unless the keys
+ * don't fit (see string_page()) */
+static size_t page_used(
 		btree_t *tree,
-		int loff,
-		int uoff,
-		const void *key,
-		btree_node_t **node,
-		int *pos,
-		void *group,
-		btree_cmp_t cmpfn)
+		btree_node_t *node)
 {
-	int u;
-	int l;
-	int m;
-	int cmp;
-	btree_node_t *node_candidate = NULL;
-	int pos_candidate = 0;
-	bool found = false;
-	btree_node_t *cur = tree->root;
-	btree_node_t *prev = NULL;
-	int prev_u;
-	int offset = 0;
+	const string_head_t *head;
+	const page_slot_t *slots;
+	size_t bytes = 0;
+	int i;
 
-	while(cur != NULL) {
-		if(loff <= offset)
-			l = 0;
-		else
-			l = subtree_pos(cur, loff - offset);
-		if(uoff >= offset + cur->links[cur->fill].offset)
-			u = cur->fill;
-		else
-			u = subtree_pos(cur, uoff - offset);
-		prev = cur;
-		prev_u = u;
-		u--;
-		while(l <= u) {
-			m = l + (u - l) / 2;
-			cmp = cmpfn(tree, GET_E(tree, cur->elements + m * tree->element_size), key, group);
-			if(cmp >= 0) {
-				node_candidate = cur;
-				pos_candidate = m;
-				u = m - 1;
-				if(cmp == 0)
-					found = true;
-			}
-			else
-				l = m + 1;
-		}
-		offset += cur->links[l].offset;
-		cur = cur->links[l].child;
+	if((tree->options & BTREE_OPT_STRING_KEYS) == 0)
+		return page_bytes(tree, node, 0, node->fill);
+	head = node_cache(tree, node);
+	if(head->prefix_len == STRING_STALE)
+		return page_bytes(tree, node, 0, node->fill);
+	slots = (const void*)head + string_head_size(NODE_LEAF);
+	for(i = 0; i < node->fill; i++)
+		bytes += sizeof(page_slot_t) + MIN(slots[i].length, page_window(tree));
+	return bytes;
+}
+
+/* BTREE_OPT_STRING_KEYS: string_page() for a single key removed from 'pos' */
+static void string_page_remove(
+		btree_t *tree,
+		btree_node_t *node,
+		int pos)
+{
+	string_head_t *head = node_cache(tree, node);
+	page_slot_t *slots = (void*)head + string_head_size(NODE_LEAF);
+
+	if(head->prefix_len == STRING_STALE || node->fill == 0)
+		string_page(tree, node);
+	else if((pos == 0 || pos == node->fill) && page_prefix(tree, node->elements, node->elements + (node->fill - 1) * tree->element_size) != head->prefix_len) /* the prefix may become longer */
+		string_page(tree, node);
+	else
+		memmove(slots + pos, slots + pos + 1, (node->fill - pos) * sizeof(page_slot_t));
+}
+
+/* BTREE_OPT_VAR_ELEMENTS: write the unpacked elements of a leaf into its page */
+static int var_pack(
+		btree_t *tree,
+		btree_node_t *node)
+{
+	packed_leaf_t *packed = node_cache(tree, node);
+	page_slot_t *slots;
+	void *element;
+	size_t end = tree->leaf_bytes;
+	size_t len;
+	int i;
+	int ret;
+
+	assert(page_bytes(tree, node, 0, node->fill) <= (size_t)tree->leaf_bytes); /* see page_adjust() */
+	ret = packed_resize(tree, packed, node->fill == 0 ? 0 : tree->leaf_bytes);
+	if(ret != 0)
+		return ret;
+	packed->dirty = false;
+
+	slots = packed->block;
+	for(i = 0; i < node->fill; i++) {
+		element = node->elements + i * tree->element_size;
+		len = var_length(tree, element);
+		end = ALIGN_DOWN(end - len, tree->element_align);
+		memcpy(packed->block + end, element, len);
+		slots[i].offset = end;
+		slots[i].length = len;
 	}
-	if(node_candidate == NULL && prev != NULL) { /* all element keys less than requested key, select imaginary element after end (rightmost leaf node) */
-		node_candidate = prev;
-		pos_candidate = prev_u;
+	return 0;
+}
+
+/* encode the unpacked elements of a leaf, if they have changed */
+static int leaf_pack(
+		btree_t *tree,
+		btree_node_t *node)
+{
+	packed_leaf_t *packed = node_cache(tree, node);
+	size_t payload = tree->element_size - sizeof(int64_t);
+	size_t deltas_size;
+	size_t size;
+	uint64_t delta;
+	uint64_t word;
+	size_t offset;
+	int64_t min = INT64_MAX;
+	int64_t max = INT64_MIN;
+	int64_t key;
+	int width;
+	int i;
+	int ret;
+
+	if(!packed->dirty)
+		return 0;
+	else if((tree->options & BTREE_OPT_DUP_RUNS) != 0)
+		return runs_pack(tree, node);
+	else if((tree->options & BTREE_OPT_VAR_ELEMENTS) != 0)
+		return var_pack(tree, node);
+	for(i = 0; i < node->fill; i++) {
+		key = packed_key(node->elements + i * tree->element_size);
+		min = MIN(min, key);
+		max = MAX(max, key);
 	}
-	if(node != NULL)
-		*node = node_candidate;
-	if(pos != NULL)
-		*pos = pos_candidate;
-	return found;
+	width = node->fill == 0 || max == min ? 0 : 64 - __builtin_clzll((uint64_t)max - (uint64_t)min);
+	if(width > 56) /* a delta must fit into a 64 bit load at any bit offset */
+		width = 64;
+	deltas_size = ((size_t)node->fill * width + 7) / 8 + PACKED_SLACK;
+	size = node->fill == 0 ? 0 : deltas_size + node->fill * payload;
+	ret = packed_resize(tree, packed, size);
+	if(ret != 0)
+		return ret;
+	packed->base = min;
+	packed->span = (uint64_t)max - (uint64_t)min;
+	packed->width = width;
+	packed->dirty = false;
+	if(size == 0)
+		return 0;
+
+	memset(packed->block, 0, deltas_size);
+	for(i = 0; i < node->fill && width > 0; i++) {
+		delta = (uint64_t)packed_key(node->elements + i * tree->element_size) - (uint64_t)min;
+		offset = (size_t)i * width;
+		word = width == 64 ? delta : load_le64(packed->block + offset / 8) | delta << (offset % 8);
+		store_le64(packed->block + offset / 8, word);
+	}
+	for(i = 0; i < node->fill; i++)
+		memcpy(packed_payload(packed, node->fill) + i * payload, node->elements + i * tree->element_size + sizeof(int64_t), payload);
+	return 0;
 }
 
-static bool find_upper(
+/* drop the unpacked elements of a leaf without packing them */
+static void leaf_release(
+		btree_t *tree,
+		btree_node_t *node)
+{
+	int i;
+
+	for(i = 0; tree->packed.open[i] != node; i++);
+	tree->packed.open[i] = tree->packed.open[--tree->packed.n_open];
+	tree->allocator.free(node->elements, unpacked_size(tree), tree->allocator.context);
+	node->elements = NULL;
+}
+
+/* packed leaves: make the elements of a leaf accessible. the
+ * elements of the least recently used leaf are packed again if too many
+ * leaves are unpacked, invalidating pointers to them */
+static int leaf_open(
+		btree_t *tree,
+		btree_node_t *node)
+{
+	packed_leaf_t *packed;
+	btree_node_t *victim;
+	void *elements;
+	int slot;
+	int i;
+	int ret;
+
+	if(!packs_leaves(tree) || node == NULL || !isleaf(node) || node == &tree->layout.root)
+		return 0;
+	packed = node_cache(tree, node);
+	packed->used = ++tree->packed.clock;
+	if(node->elements != NULL)
+		return 0;
+
+	if(tree->packed.n_open < PACKED_OPEN) {
+		elements = tree->allocator.alloc(unpacked_size(tree), MAX(NODE_ALIGN, tree->element_align), tree->allocator.context);
+		if(elements == NULL)
+			return -ENOMEM;
+		slot = tree->packed.n_open++;
+	}
+	else { /* take over the memory of the least recently used leaf */
+		slot = 0;
+		for(i = 1; i < PACKED_OPEN; i++)
+			if(((packed_leaf_t*)node_cache(tree, tree->packed.open[i]))->used < ((packed_leaf_t*)node_cache(tree, tree->packed.open[slot]))->used)
+				slot = i;
+		victim = tree->packed.open[slot];
+		ret = leaf_pack(tree, victim);
+		if(ret != 0)
+			return ret;
+		elements = victim->elements;
+		victim->elements = NULL;
+	}
+	tree->packed.open[slot] = node;
+	node->elements = elements;
+	for(i = 0; i < node->fill; i++)
+		packed_get(tree, node, i, node->elements + i * tree->element_size);
+	packed->dirty = false;
+	return 0;
+}
+
+/* pack an unpacked leaf and release its unpacked elements */
+static int leaf_close(
+		btree_t *tree,
+		btree_node_t *node)
+{
+	int ret;
+
+	if(node->elements == NULL)
+		return 0;
+	ret = leaf_pack(tree, node);
+	if(ret != 0)
+		return ret;
+	leaf_release(tree, node);
+	return 0;
+}
+
+/* release all memory of a leaf which is about to be freed */
+static void leaf_discard(
+		btree_t *tree,
+		btree_node_t *node)
+{
+	packed_leaf_t *packed = node_cache(tree, node);
+
+	if(node->elements != NULL)
+		leaf_release(tree, node);
+	if(packed->block != NULL)
+		tree->allocator.free(packed->block, packed->block_size, tree->allocator.context);
+	tree->packed.block_bytes -= packed->block_size;
+	memset(packed, 0, sizeof(*packed));
+}
+
+/* called whenever the elements of a node have changed, updates the data derived from them */
+static inline void node_changed(
+		btree_t *tree,
+		btree_node_t *node)
+{
+	if((tree->options & BTREE_OPT_STRING_KEYS) != 0 && paged(tree, node))
+		string_page(tree, node);
+	else if((tree->options & BTREE_OPT_STRING_KEYS) != 0)
+		string_build(tree, node);
+	else if((tree->options & BTREE_OPT_KEY_COLUMN) != 0)
+		column_build(tree, node);
+	else if((tree->options & BTREE_OPT_KEY_PREFIX) != 0)
+		prefix_build(tree, node);
+	else if(tree->key_type != BTREE_KEY_NONE)
+		int_build(tree, node);
+	else if(packs_leaves(tree) && isleaf(node) && node->elements != NULL)
+		((packed_leaf_t*)node_cache(tree, node))->dirty = true;
+}
+
+/* node_changed() for a single element inserted at 'pos' */
+static inline void node_inserted(
+		btree_t *tree,
+		btree_node_t *node,
+		int pos)
+{
+	if((tree->options & BTREE_OPT_STRING_KEYS) != 0 && paged(tree, node))
+		string_page_insert(tree, node, pos);
+	else
+		node_changed(tree, node);
+}
+
+/* node_changed() for a single element removed from 'pos' */
+static inline void node_removed(
+		btree_t *tree,
+		btree_node_t *node,
+		int pos)
+{
+	if((tree->options & BTREE_OPT_STRING_KEYS) != 0 && paged(tree, node))
+		string_page_remove(tree, node, pos);
+	else
+		node_changed(tree, node);
+}
+
+static inline void search_key_init(
 		btree_t *tree,
 		const void *key,
-		btree_node_t **node,
-		int *pos,
-		void *group,
-		btree_cmp_t cmpfn)
+		btree_cmp_t cmpfn,
+		search_key_t *q)
 {
-	int u;
-	int l;
-	int m;
+	const void *bytes;
+
+	memset(q, 0, sizeof(*q));
+	if(cmpfn == string_cmp && !isstatic(tree)) { /* a static layout has no slots, compare the elements */
+		q->mode = SEARCH_STRING;
+		q->len = tree->hook_string(tree, key, &bytes);
+		q->bytes = bytes;
+	}
+	else if(cmpfn == column_cmp && !isstatic(tree))
+		q->mode = SEARCH_COLUMN;
+	else if(cmpfn == packed_cmp) {
+		q->mode = SEARCH_PACKED;
+		q->key = packed_key(key);
+	}
+	else if((tree->options & BTREE_OPT_KEY_PREFIX) != 0 && cmpfn == tree->hook_cmp && !isstatic(tree)) { /* the prefixes are ordered like the tree */
+		q->mode = SEARCH_PREFIX;
+		q->prefix = tree->hook_prefix(tree, key);
+	}
+	else if(cmpfn == int_cmp && !isstatic(tree)) { /* a static layout has no keys besides its elements */
+		q->mode = SEARCH_INT;
+		q->key = int_key(tree, key);
+	}
+}
+
+/* prepare the search key for comparisons against the elements of 'node' */
+static inline void search_key_node(
+		btree_t *tree,
+		btree_node_t *node,
+		search_key_t *q)
+{
+	const string_head_t *head;
 	int cmp;
-	btree_node_t *node_candidate = NULL;
-	int pos_candidate = 0;
-	bool found = false;
-	btree_node_t *cur = tree->root;
-	btree_node_t *prev = NULL;
 
-	while(cur != NULL) {
-		u = cur->fill - 1;
-		l = 0;
-		prev = cur;
-		while(l <= u) {
-			m = l + (u - l) / 2;
-			cmp = cmpfn(tree, GET_E(tree, cur->elements + m * tree->element_size), key, group);
-			if(cmp > 0) {
-				node_candidate = cur;
-				pos_candidate = m;
-				u = m - 1;
-			}
-			else {
-				if(cmp == 0)
-					found = true;
-				l = m + 1;
-			}
+	if(packs_leaves(tree) && isleaf(node) && node->elements == NULL) {
+		q->packed = node_cache(tree, node);
+		if(q->mode != SEARCH_PACKED)
+			return;
+		else if(q->key < q->packed->base)
+			q->node_cmp = 1;
+		else if((uint64_t)q->key - (uint64_t)q->packed->base > q->packed->span)
+			q->node_cmp = -1;
+		else {
+			q->node_cmp = 0;
+			q->delta = (uint64_t)q->key - (uint64_t)q->packed->base;
 		}
-		cur = cur->links[l].child;
+		return;
 	}
-
-	if(node_candidate == NULL && prev != NULL) { /* all element keys less than requested key, select imaginary element after end (rightmost leaf node) */
-		node_candidate = prev;
-		pos_candidate = prev->fill;
+	q->packed = NULL;
+	if(q->mode != SEARCH_STRING)
+		return;
+	head = node_cache(tree, node);
+	q->slots = NULL;
+	q->page = NULL;
+	if(head->prefix_len == STRING_STALE) { /* see string_page() */
+		q->node_cmp = 0;
+		return;
 	}
-	if(node != NULL)
-		*node = node_candidate;
-	if(pos != NULL)
-		*pos = pos_candidate;
-	return found;
+	else if(paged(tree, node))
+		q->page = (const void*)head + string_head_size(NODE_LEAF);
+	else
+		q->slots = (const void*)head + string_head_size(NODE_INTERIOR);
+	cmp = MIN(q->len, head->prefix_len) == 0 ? 0 : memcmp(head->prefix, q->bytes, MIN(q->len, head->prefix_len));
+	q->prefix_len = head->prefix_len;
+	if(cmp != 0)
+		q->node_cmp = cmp;
+	else if(q->len < head->prefix_len) /* key is a prefix of all elements */
+		q->node_cmp = 1;
+	else
+		q->node_cmp = 0;
 }
 
-static bool find_upper_in(
+/* compare element 'm' of 'node' against the search key; arguments as for 'cmpfn' */
+static inline int key_cmp(
 		btree_t *tree,
-		int loff,
-		int uoff,
+		btree_node_t *node,
+		int m,
 		const void *key,
-		btree_node_t **node,
-		int *pos,
 		void *group,
-		btree_cmp_t cmpfn)
+		btree_cmp_t cmpfn,
+		const search_key_t *q)
 {
-	int u;
-	int l;
-	int m;
+	const string_slot_t *slot;
+	const page_slot_t *page_slot;
+	const uint8_t *bytes;
+	size_t slot_len;
+	size_t window;
+	uint64_t delta;
+	uint64_t prefix;
+	int64_t element;
+	size_t len;
+	size_t n;
 	int cmp;
-	btree_node_t *node_candidate = NULL;
-	int pos_candidate = 0;
-	bool found = false;
-	btree_node_t *cur = tree->root;
-	btree_node_t *prev = NULL;
-	int prev_u;
-	int offset = 0;
 
-	while(cur != NULL) {
-		if(loff <= offset)
-			l = 0;
-		else {
-			l = subtree_pos(cur, loff - offset);
-			assert(l <= cur->fill);
-			assert(l >= 0);
-		}
-		if(uoff >= offset + cur->links[cur->fill].offset)
-			u = cur->fill;
-		else {
-			u = subtree_pos(cur, uoff - offset);
-			assert(u <= cur->fill);
-			assert(u >= 0);
-		}
-		prev = cur;
-		prev_u = u;
-		u--;
-		while(l <= u) {
-			m = l + (u - l) / 2;
-			cmp = cmpfn(tree, GET_E(tree, cur->elements + m * tree->element_size), key, group);
-			if(cmp > 0) {
-				node_candidate = cur;
-				pos_candidate = m;
-				u = m - 1;
-			}
-			else {
-				if(cmp == 0)
-					found = true;
-				l = m + 1;
-			}
-		}
-		offset += cur->links[l].offset;
-		cur = cur->links[l].child;
+	if(q->mode == SEARCH_CALLBACK && q->packed != NULL && (tree->options & BTREE_OPT_VAR_ELEMENTS) != 0) /* elements are stored as they are */
+		return cmpfn(tree, var_element(q->packed, m, &len), key, group);
+	else if(q->mode == SEARCH_CALLBACK && q->packed != NULL) { /* decode the element into the overflow slot, which is unused while searching */
+		packed_get(tree, node, m, tree->overflow_element);
+		return cmpfn(tree, tree->overflow_element, key, group);
+	}
+	else if(q->mode == SEARCH_CALLBACK)
+		return cmpfn(tree, GET_E(tree, node_element(tree, node, m)), key, group);
+	else if(q->mode == SEARCH_COLUMN)
+		return tree->hook_key_cmp(tree, node_cache(tree, node) + m * tree->key_size, key, group);
+	else if(q->mode == SEARCH_PREFIX) {
+		prefix = ((const uint64_t*)node_cache(tree, node))[m];
+		if(prefix != q->prefix)
+			return prefix > q->prefix ? 1 : -1;
+		return cmpfn(tree, GET_E(tree, node_element(tree, node, m)), key, group);
+	}
+	else if(q->mode == SEARCH_PACKED && q->packed != NULL) {
+		if(q->node_cmp != 0)
+			return q->node_cmp;
+		delta = packed_delta(q->packed, m);
+		return (delta > q->delta) - (delta < q->delta);
+	}
+	else if(q->mode == SEARCH_PACKED) {
+		element = packed_key(node->elements + m * tree->element_size);
+		return (element > q->key) - (element < q->key);
+	}
+	else if(q->mode == SEARCH_INT) {
+		element = tree->key_type == BTREE_KEY_INT32 ? ((const int32_t*)node_cache(tree, node))[m] : ((const int64_t*)node_cache(tree, node))[m];
+		return (element > q->key) - (element < q->key);
+	}
+	else if(q->node_cmp != 0)
+		return q->node_cmp;
+	else if(q->page != NULL) { /* leaf: the key bytes following the prefix, up to page_window() */
+		page_slot = (const page_slot_t*)q->page + m;
+		bytes = q->page + page_slot->offset;
+		slot_len = page_slot->length;
+		window = page_window(tree);
+	}
+	else if(q->slots != NULL) {
+		slot = q->slots + m;
+		bytes = slot->bytes;
+		slot_len = slot->len;
+		window = STRING_WINDOW;
+	}
+	else
+		return string_cmp(tree, GET_E(tree, node_element(tree, node, m)), key, group);
+
+	len = MIN(q->len - q->prefix_len, window + 1);
+	n = MIN(MIN(slot_len, len), window);
+	cmp = n == 0 ? 0 : memcmp(bytes, q->bytes + q->prefix_len, n);
+	if(cmp != 0)
+		return cmp;
+	else if(slot_len > window && len > window) /* both keys continue beyond the slot */
+		return string_cmp(tree, GET_E(tree, node_element(tree, node, m)), key, group);
+	else
+		return (slot_len > len) - (slot_len < len);
+}
+
+/* number of elements the inline root can hold; it must fit into a regular leaf */
+static inline int small_capacity(
+		btree_t *tree)
+{
+	return MIN(tree->small_max, tree->leaf_order - 1);
+}
+
+/* the inline root is full: move its elements into a regular leaf, which becomes the root */
+static int small_promote(
+		btree_t *tree)
+{
+	btree_node_t *leaf = alloc_node(tree, NODE_LEAF);
+
+	if(leaf == NULL)
+		return -ENOMEM;
+	memcpy(leaf->elements, tree->small.elements, tree->small.fill * tree->element_size);
+	leaf->fill = tree->small.fill;
+	node_changed(tree, leaf);
+	tree->small.fill = 0;
+	tree->root = leaf;
+	return 0;
+}
+
+/* move the elements of a root leaf into the inline root if it holds at most 'limit' of them */
+static void small_demote(
+		btree_t *tree,
+		int limit)
+{
+	btree_node_t *leaf = tree->root;
+
+	if(leaf == NULL || leaf == &tree->small || isstatic(tree) || !isleaf(leaf) || leaf->fill > MIN(limit, small_capacity(tree)))
+		return;
+	memcpy(tree->small.elements, leaf->elements, leaf->fill * tree->element_size);
+	tree->small.fill = leaf->fill;
+	tree->root = &tree->small;
+	free_node(tree, leaf);
+}
+
+static int newroot(
+		btree_t *tree)
+{
+	btree_node_t *root;
+
+	if(tree->root == NULL && small_capacity(tree) > 0) { /* small trees start out with the inline root */
+		tree->small.fill = 0;
+		tree->root = &tree->small;
+		return 0;
+	}
+	root = alloc_node(tree, tree->root == NULL ? NODE_LEAF : NODE_INTERIOR);
+	if(root == NULL)
+		return -ENOMEM;
+	if(tree->root != NULL) {
+		tree->root->parent = root;
+		tree->root->child_index = 0;
+		root->links[0].child = tree->root;
+		root->links[0].count = subtree_size(tree, tree->root);
 	}
+	tree->root = root;
+	return 0;
+}
+
+/* does not split root node;
+ * node must be overflowing */
+/* make room for a new element at position 'pos'. permuted leaves only
+ * shift their slot indices, the new element goes into an unused slot */
+static void open_position(
+		btree_t *tree,
+		btree_node_t *node,
+		int pos)
+{
+	uint8_t *perm;
+	uint8_t slot;
+
+	if(permutes(tree, node)) {
+		perm = node_perm(tree, node);
+		slot = perm[node->fill];
+		memmove(perm + pos + 1, perm + pos, node->fill - pos);
+		perm[pos] = slot;
+	}
+	else
+		memmove(node->elements + (pos + 1) * tree->element_size, node->elements + pos * tree->element_size, (node->fill - pos) * tree->element_size);
+}
+
+/* remove the element at position 'pos', the following ones move up. the
+ * last position holds an unused element afterwards, the caller decreases
+ * the fill of the node or puts another element there */
+static void close_position(
+		btree_t *tree,
+		btree_node_t *node,
+		int pos)
+{
+	uint8_t *perm;
+	uint8_t slot;
+
+	if(permutes(tree, node)) {
+		perm = node_perm(tree, node);
+		slot = perm[pos];
+		memmove(perm + pos, perm + pos + 1, node->fill - pos - 1);
+		perm[node->fill - 1] = slot;
+	}
+	else
+		memmove(node->elements + pos * tree->element_size, node->elements + (pos + 1) * tree->element_size, (node->fill - pos - 1) * tree->element_size);
+}
+
+/* copy 'n' elements from one node to another */
+static void copy_elements(
+		btree_t *tree,
+		btree_node_t *dst,
+		int dst_pos,
+		btree_node_t *src,
+		int src_pos,
+		int n)
+{
+	int i;
+
+	if(!permutes(tree, dst) && !permutes(tree, src))
+		memcpy(dst->elements + dst_pos * tree->element_size, src->elements + src_pos * tree->element_size, n * tree->element_size);
+	else
+		for(i = 0; i < n; i++)
+			memcpy(node_element(tree, dst, dst_pos + i), node_element(tree, src, src_pos + i), tree->element_size);
+}
+
+/* zero 'n' elements of a node, starting at position 'pos' */
+static void clear_elements(
+		btree_t *tree,
+		btree_node_t *node,
+		int pos,
+		int n)
+{
+	int i;
+
+	if(!permutes(tree, node))
+		memset(node->elements + pos * tree->element_size, 0, n * tree->element_size);
+	else
+		for(i = 0; i < n; i++)
+			memset(node_element(tree, node, pos + i), 0, tree->element_size);
+}
+
+/* position of the element of an overflowing leaf page moving up into the
+ * parent, so that both halves take about the same bytes. the overflow element
+ * is the last one. the left half always fits into its page; the right one may
+ * still exceed it if the common prefix of string keys became shorter */
+static int page_split(
+		btree_t *tree,
+		btree_node_t *node)
+{
+	size_t prefix = page_prefix(tree, node_element(tree, node, 0), tree->overflow_element);
+	size_t total = page_record(tree, tree->overflow_element, prefix);
+	size_t left = page_record(tree, node_element(tree, node, 0), prefix);
+	size_t best = SIZE_MAX;
+	size_t record;
+	int sidx = 1;
+	int i;
+
+	for(i = 0; i < node->fill; i++)
+		total += page_record(tree, node_element(tree, node, i), prefix);
+	for(i = 1; i < node->fill && left <= (size_t)tree->leaf_bytes; i++) { /* halves keep at least 'prefix', they take these bytes at most */
+		record = page_record(tree, node_element(tree, node, i), prefix);
+		if(MAX(left, total - left - record) < best) {
+			best = MAX(left, total - left - record);
+			sidx = i;
+		}
+		left += record;
+	}
+	return sidx;
+}
+
+static int split(
+		btree_t *tree,
+		btree_node_t *l)
+{
+	btree_node_t *p;
+	btree_node_t *r;
+	btree_link_t *rlink;
+	int sidx = paged(tree, l) ? page_split(tree, l) : node_order(tree, l) / 2;
+	bool leaf = isleaf(l);
+	int i;
+	btree_index_t n;
+	int ret;
+
+	assert(l == tree->overflow_node);
+	assert(l != tree->root);
+	assert(near_overflowing(tree, l) || paged(tree, l));
+
+	p = l->parent;
+ 	r = alloc_node(tree, node_kind(l));
+	if(r == NULL)
+		return -ENOMEM;
+	ret = leaf_open(tree, r);
+	if(ret != 0) {
+		free_node(tree, r);
+		return ret;
+	}
+
+	r->parent = p;
+	r->child_index = l->child_index + 1;
+	r->fill = l->fill - sidx;
+
+	/* copy overflow data to back of right node */
+	memcpy(node_element(tree, r, r->fill - 1), tree->overflow_element, tree->element_size); /* move overflow element to last position of right node */
+	if(!leaf)
+		memcpy(r->links + r->fill, &tree->overflow_link, sizeof(btree_link_t)); /* move overflow link to last position of right node */
+
+	/* insert new right node into parent */
+	if(r->child_index == tree->order) { /* new right node will be in overflow position */
+		memcpy(tree->overflow_element, node_element(tree, l, sidx), tree->element_size); /* move single element from left node to overflow */
+		rlink = &tree->overflow_link;
+		tree->overflow_node = p;
+	}
+	else {
+		if(p->fill == tree->order - 1) { /* parent will overflow, move last element to overflow position */
+			memcpy(tree->overflow_element, p->elements + (p->fill - 1) * tree->element_size, tree->element_size);
+			memcpy(&tree->overflow_link, p->links + p->fill, sizeof(btree_link_t));
+			if(tree->overflow_link.child != NULL)
+				tree->overflow_link.child->child_index = tree->order;
+			tree->overflow_node = p;
+			p->fill--;
+		}
+		else { /* parent will not overflow, clear overflow position */
+			memset(tree->overflow_element, 0, tree->element_size);
+			memset(&tree->overflow_link, 0, sizeof(btree_link_t));
+			tree->overflow_node = NULL;
+		}
+		memmove(p->elements + (l->child_index + 1) * tree->element_size, p->elements + l->child_index * tree->element_size, (p->fill - l->child_index) * tree->element_size); /* insert new element at l->child_index */
+		memmove(p->links + l->child_index + 2, p->links + l->child_index + 1, (p->fill - l->child_index) * sizeof(btree_link_t)); /* insert new link at l->child_index + 1 */
+		memcpy(p->elements + l->child_index * tree->element_size, node_element(tree, l, sidx), tree->element_size); /* move single element from left node to parent */
+		rlink = p->links + r->child_index;
+
+		p->fill++;
+	}
+	rlink->child = r;
+
+	copy_elements(tree, r, 0, l, sidx + 1, r->fill - 1); /* move all remaining elements except overflow element from left node to right node */
+	clear_elements(tree, l, sidx, r->fill); /* clear moved elements in left node */
+	if(!leaf) {
+		memcpy(r->links, l->links + sidx + 1, r->fill * sizeof(btree_link_t)); /* move links except overflow link from left node to right node */
+		memset(l->links + sidx + 1, 0, r->fill * sizeof(btree_link_t)); /* clear moved links in left node */
+	}
+	l->fill = sidx;
+	for(i = l->child_index + 1; i <= p->fill; i++) /* update child indices in parent */
+		if(p->links[i].child != NULL)
+			p->links[i].child->child_index = i;
+
+	if(leaf)
+		n = r->fill;
+	else {
+		for(i = 0; i <= r->fill; i++) { /* update links in right node */
+			r->links[i].child->parent = r;
+			r->links[i].child->child_index = i;
+		}
+		n = 0;
+		for(i = 0; i <= r->fill; i++) {
+			r->links[i].offset = n;
+			n += r->links[i].count + 1;
+		}
+		n--;
+	}
+	p->links[l->child_index].count -= n + 1; /* n elements go to right node, one element to parent node */
+	rlink->count = n;
+	rlink->offset = p->links[l->child_index].offset + p->links[l->child_index].count + 1;
+	node_changed(tree, l);
+	node_changed(tree, r);
+	node_changed(tree, p);
+	return 0;
+}
+
+static void concatenate(
+		btree_t *tree,
+		btree_node_t *l)
+{
+	btree_node_t *p;
+	btree_node_t *r;
+	bool leaf = isleaf(l);
+	int i;
+	btree_index_t n;
+
+	assert(tree->overflow_node == NULL);
+	assert(l->child_index < tree->order - 1);
+
+	p = l->parent;
+	r = p->links[l->child_index + 1].child;
+
+	assert(l->fill + 1 + r->fill <= node_order(tree, l));
+
+	if(l->fill + 1 + r->fill == node_order(tree, l)) { /* left element will overflow */
+		memcpy(tree->overflow_element, node_element(tree, r, r->fill - 1), tree->element_size); /* move last element of right node into overflow position */
+		if(!leaf) {
+			memcpy(&tree->overflow_link, r->links + r->fill, sizeof(btree_link_t)); /* move last link of right node into overflow position */
+			tree->overflow_link.child->parent = l;
+			tree->overflow_link.child->child_index = tree->order;
+		}
+		tree->overflow_node = l;
+		r->fill--;
+	}
+	memcpy(node_element(tree, l, l->fill), p->elements + l->child_index * tree->element_size, tree->element_size); /* append element from parent to left node */
+	copy_elements(tree, l, l->fill + 1, r, 0, r->fill); /* append elements except overflow from right node to left node */
+	if(!leaf)
+		memcpy(l->links + l->fill + 1, r->links, (r->fill + 1) * sizeof(btree_link_t)); /* append links except overflow from right node to left node */
+	l->fill += 1 + r->fill;
+
+	p->fill--;
+	memmove(p->elements + l->child_index * tree->element_size, p->elements + (l->child_index + 1) * tree->element_size, (p->fill - l->child_index) * tree->element_size); /* delete element from parent */
+	memmove(p->links + l->child_index + 1, p->links + l->child_index + 2, (p->fill - l->child_index) * sizeof(btree_link_t)); /* delete link from parent */
+	memset(p->elements + p->fill * tree->element_size, 0, tree->element_size); /* clear last element from parent */
+	memset(p->links + p->fill + 1, 0, sizeof(btree_link_t)); /* clear last link from parent */
+	if(!leaf)
+		for(i = l->fill - r->fill; i <= l->fill; i++) {
+			l->links[i].child->parent = l;
+			l->links[i].child->child_index = i;
+		}
+	for(i = l->child_index + 1; i <= p->fill; i++)
+		if(p->links[i].child != NULL)
+			p->links[i].child->child_index = i;
+
+	free_node(tree, r);
+
+	if(leaf)
+		n = l->fill;
+	else {
+		n = 0;
+		for(i = 0; i <= l->fill; i++) {
+			l->links[i].offset = n;
+			n += l->links[i].count + 1;
+		}
+		n--;
+	}
+	if(tree->overflow_node == l) {
+		n++;
+		if(!leaf) {
+			tree->overflow_link.offset = n;
+			n += tree->overflow_link.count;
+		}
+	}
+	p->links[l->child_index].count = n;
+	node_changed(tree, l);
+	node_changed(tree, p);
+}
+
+/* move last element of node 'l' to parent;
+ * move element at corresponding parent position to beginning of right sibling
+ * note: right sibling must not be full */
+static void lr_redistribute(
+		btree_t *tree,
+		btree_node_t *l)
+{
+	btree_node_t *p;
+	btree_node_t *r;
+	bool leaf = isleaf(l);
+	int i;
+	btree_index_t n;
+
+	assert(l == tree->overflow_node || tree->overflow_node == NULL);
+	assert(l != tree->root);
+	assert(l->child_index < tree->order - 1);
+
+	p = l->parent;
+	r = p->links[l->child_index + 1].child;
+
+	assert(!near_overflowing(tree, r));
+
+	open_position(tree, r, 0); /* insert new first element at right node */
+	if(!leaf)
+		memmove(r->links + 1, r->links, (r->fill + 1) * sizeof(btree_link_t)); /* insert new link at right node */
+	memcpy(node_element(tree, r, 0), p->elements + l->child_index * tree->element_size, tree->element_size); /* move element from parent to first position at right node */
+	if(l == tree->overflow_node) {
+		memcpy(p->elements + l->child_index * tree->element_size, tree->overflow_element, tree->element_size); /* move overflow element from left node to parent */
+		if(!leaf)
+			memcpy(r->links, &tree->overflow_link, sizeof(btree_link_t)); /* move overflow link from left node to first link of right node */
+		memset(tree->overflow_element, 0, tree->element_size); /* clear overflow element */
+		memset(&tree->overflow_link, 0, sizeof(btree_link_t)); /* clear overflow link */
+		tree->overflow_node = NULL;
+	}
+	else {
+		memcpy(p->elements + l->child_index * tree->element_size, node_element(tree, l, l->fill - 1), tree->element_size); /* move last element from left node to parent */
+		memset(node_element(tree, l, l->fill - 1), 0, tree->element_size); /* clear last element from left node */
+		if(!leaf) {
+			memcpy(r->links, l->links + l->fill, sizeof(btree_link_t)); /* move last link from left node to first link of right node */
+			memset(l->links + l->fill, 0, sizeof(btree_link_t)); /* clear last link of left node */
+		}
+		l->fill--;
+	}
+	r->fill++;
+
+	if(leaf)
+		n = 1; /* number of elements moved from left to right... */
+	else {
+		r->links[0].child->parent = r;
+		for(i = 0; i <= r->fill; i++)
+			r->links[i].child->child_index = i;
+		n = r->links[0].count + 1;
+	}
+	p->links[l->child_index].count -= n; /* ...which are missing on left node now */
+	p->links[r->child_index].count += n; /* ...are present on right node now */
+	p->links[r->child_index].offset -= n; /* ...which shift the offset of the right node */
+	if(!leaf) {
+		r->links[0].offset = 0;
+		for(i = 1; i <= r->fill; i++)
+			r->links[i].offset += n; /* ...and the offset of all consecutive links on right node */
+	}
+	node_changed(tree, l);
+	node_changed(tree, r);
+	node_changed(tree, p);
+}
+
+/* move first element of node 'r' to parent;
+ * move element at corresponding parent position to first free of left sibling
+ * note: left sibling must not be full */
+static void rl_redistribute(
+		btree_t *tree,
+		btree_node_t *r)
+{
+	btree_node_t *p;
+	btree_node_t *l;
+	bool leaf = isleaf(r);
+	int i;
+	btree_index_t n;
+
+	assert(r == tree->overflow_node || tree->overflow_node == NULL);
+	assert(r != tree->root);
+	assert(r->child_index > 0);
+
+	p = r->parent;
+	l = p->links[r->child_index - 1].child;
+
+	assert(!near_overflowing(tree, l));
+
+	memcpy(node_element(tree, l, l->fill), p->elements + l->child_index * tree->element_size, tree->element_size); /* move element from parent to last position at left node */
+	memcpy(p->elements + l->child_index * tree->element_size, node_element(tree, r, 0), tree->element_size); /* move first element from right node to parent */
+	close_position(tree, r, 0); /* delete first element at right node */
+	if(!leaf) {
+		memcpy(l->links + l->fill + 1, r->links, sizeof(btree_link_t)); /* move first link from right node to left node */
+		memmove(r->links, r->links + 1, r->fill * sizeof(btree_link_t)); /* delete first link at right node */
+	}
+	l->fill++;
+	if(tree->overflow_node == r) {
+		memmove(node_element(tree, r, r->fill - 1), tree->overflow_element, tree->element_size);
+		if(!leaf)
+			memmove(r->links + r->fill, &tree->overflow_link, sizeof(btree_link_t));
+		memset(tree->overflow_element, 0, tree->element_size); /* clear overflow element */
+		memset(&tree->overflow_link, 0, sizeof(btree_link_t)); /* clear overflow link */
+		tree->overflow_node = NULL;
+	}
+	else {
+		memset(node_element(tree, r, r->fill - 1), 0, tree->element_size); /* clear last element from right node */
+		if(!leaf)
+			memset(r->links + r->fill, 0, sizeof(btree_link_t)); /* clear last link from right node */
+		r->fill--;
+	}
+
+	if(leaf)
+		n = 1;
+	else {
+		for(i = 0; i <= r->fill; i++)
+			r->links[i].child->child_index = i;
+		n = l->links[l->fill].count + 1;
+	}
+	p->links[l->child_index].count += n;
+	p->links[r->child_index].count -= n;
+	p->links[r->child_index].offset += n;
+	if(!leaf) {
+		if(l->fill == 0)
+			l->links[0].offset = 0;
+		else
+			l->links[l->fill].offset = l->links[l->fill - 1].offset + l->links[l->fill - 1].count + 1;
+		l->links[l->fill].child->parent = l;
+		l->links[l->fill].child->child_index = l->fill;
+		for(i = 0; i <= r->fill; i++)
+			r->links[i].offset -= n;
+	}
+	node_changed(tree, l);
+	node_changed(tree, r);
+	node_changed(tree, p);
+}
+
+/* the leaf doesn't fit into its page, or it holds more elements than its
+ * element array has room for (see overflowing()) */
+static bool page_overflowing(
+		btree_t *tree,
+		btree_node_t *node)
+{
+	if(overflowing(tree, node))
+		return true;
+	else if(node->fill * page_record_max(tree) <= (size_t)tree->leaf_bytes) /* even the largest elements fit */
+		return false;
+	else
+		return page_used(tree, node) > (size_t)tree->leaf_bytes;
+}
+
+/* move 'k' elements of leaf page 'l' to its right sibling
+ * through the element separating them in the parent, or -'k' elements of the
+ * sibling to 'l' if 'k' is negative. both leaves must be unpacked */
+static void page_shift(
+		btree_t *tree,
+		btree_node_t *l,
+		int k)
+{
+	btree_node_t *p = l->parent;
+	btree_node_t *r = p->links[l->child_index + 1].child;
+	void *separator = p->elements + l->child_index * tree->element_size;
+	size_t size = tree->element_size;
+
+	if(k > 0) {
+		memmove(r->elements + k * size, r->elements, r->fill * size);
+		memcpy(r->elements + (k - 1) * size, separator, size);
+		memcpy(r->elements, l->elements + (l->fill - k + 1) * size, (k - 1) * size);
+		memcpy(separator, l->elements + (l->fill - k) * size, size);
+		memset(l->elements + (l->fill - k) * size, 0, k * size);
+	}
+	else if(k < 0) {
+		memcpy(l->elements + l->fill * size, separator, size);
+		memcpy(l->elements + (l->fill + 1) * size, r->elements, (-k - 1) * size);
+		memcpy(separator, r->elements + (-k - 1) * size, size);
+		memmove(r->elements, r->elements - k * size, (r->fill + k) * size);
+		memset(r->elements + (r->fill + k) * size, 0, -k * size);
+	}
+	else
+		return;
+	l->fill -= k;
+	r->fill += k;
+	p->links[l->child_index].count -= k;
+	p->links[r->child_index].count += k;
+	p->links[r->child_index].offset -= k;
+	node_changed(tree, l);
+	node_changed(tree, r);
+	node_changed(tree, p);
+}
+
+/* element 'i' of the sequence formed by the elements of leaf 'l', the element
+ * separating it from its right sibling and the elements of that sibling */
+static inline void *page_pair_element(
+		btree_t *tree,
+		btree_node_t *l,
+		int i)
+{
+	btree_node_t *p = l->parent;
+	btree_node_t *r = p->links[l->child_index + 1].child;
+
+	if(i < l->fill)
+		return l->elements + i * tree->element_size;
+	else if(i == l->fill)
+		return p->elements + l->child_index * tree->element_size;
+	else
+		return r->elements + (i - l->fill - 1) * tree->element_size;
+}
+
+/* merge leaf page 'l' with its right sibling if both fit into a single page,
+ * otherwise move elements between them, so that both take about the same
+ * bytes. of their elements and their separator, viewed as one sequence, the
+ * element becoming the separator is chosen. both leaves must be unpacked */
+static int page_balance(
+		btree_t *tree,
+		btree_node_t *l)
+{
+	btree_node_t *p = l->parent;
+	btree_node_t *r = p->links[l->child_index + 1].child;
+	int capacity = tree->leaf_order - 1;
+	int n = l->fill + 1 + r->fill;
+	size_t prefix = page_prefix(tree, page_pair_element(tree, l, 0), page_pair_element(tree, l, n - 1));
+	size_t total = 0;
+	size_t left = 0;
+	size_t best = SIZE_MAX;
+	size_t record;
+	int sidx = l->fill;
+	int i;
+
+	for(i = 0; i < n; i++)
+		total += page_record(tree, page_pair_element(tree, l, i), prefix);
+	if(n <= capacity && total <= (size_t)tree->leaf_bytes) {
+		concatenate(tree, l);
+		return adjust(tree, p);
+	}
+
+	for(i = 0; i < n - 1; i++) { /* both sides keep at least 'prefix', they take these bytes at most */
+		record = page_record(tree, page_pair_element(tree, l, i), prefix);
+		if(i > 0 && i <= capacity && n - 1 - i <= capacity && left <= (size_t)tree->leaf_bytes && total - left - record <= (size_t)tree->leaf_bytes &&
+				MAX(left, total - left - record) < best) {
+			best = MAX(left, total - left - record);
+			sidx = i;
+		}
+		left += record;
+	}
+	page_shift(tree, l, l->fill - sidx);
+	return 0;
+}
+
+/* BTREE_OPT_VAR_ELEMENTS, BTREE_OPT_STRING_KEYS: adjust() for leaves, which
+ * are balanced by the bytes they take within their pages rather than by their
+ * number of elements. a leaf exceeding its page is split in two halves of
+ * about the same bytes. a leaf taking less than a quarter of its page is
+ * merged with a sibling if both fit into a single page, otherwise the
+ * elements of both are balanced by bytes */
+static int page_adjust(
+		btree_t *tree,
+		btree_node_t *node)
+{
+	btree_node_t *left;
+	btree_node_t *right;
+	int ret;
+
+	if((ret = leaf_open(tree, node)) != 0)
+		return ret;
+	if(page_overflowing(tree, node)) {
+		if(!overflowing(tree, node)) { /* the last element becomes the overflow element, as if the leaf were full */
+			memcpy(tree->overflow_element, node_element(tree, node, node->fill - 1), tree->element_size);
+			memset(node_element(tree, node, node->fill - 1), 0, tree->element_size);
+			tree->overflow_node = node;
+			node->fill--;
+		}
+		if(node->parent == NULL && (ret = newroot(tree)) != 0)
+			return ret;
+		else if((ret = split(tree, node)) != 0)
+			return ret;
+		right = node->child_index + 1 == tree->order ? tree->overflow_link.child : node->parent->links[node->child_index + 1].child;
+		if(tree->overflow_node != NULL && (ret = adjust(tree, tree->overflow_node)) != 0)
+			return ret;
+		if((ret = leaf_open(tree, right)) == 0 && page_overflowing(tree, right)) /* see page_split() */
+			ret = page_adjust(tree, right);
+		return ret;
+	}
+	else if(node->parent == NULL || page_used(tree, node) >= (size_t)tree->leaf_bytes / 4)
+		return 0;
+
+	left = left_sibling(tree, node);
+	right = right_sibling(tree, node);
+	if((ret = leaf_open(tree, left)) != 0 || (ret = leaf_open(tree, right)) != 0 || (ret = leaf_open(tree, node)) != 0)
+		return ret;
+	return page_balance(tree, right != NULL ? node : left);
+}
+
+static int adjust(
+		btree_t *tree,
+		btree_node_t *node)
+{
+	int ret = 0;
+	btree_node_t *left;
+	btree_node_t *right;
+	if(paged(tree, node))
+		return page_adjust(tree, node);
+	if(isleaf(node) && (overflowing(tree, node) || underflowing(tree, node))) { /* siblings may receive elements */
+		if((ret = leaf_open(tree, node)) != 0 || (ret = leaf_open(tree, left_sibling(tree, node))) != 0 || (ret = leaf_open(tree, right_sibling(tree, node))) != 0)
+			return ret;
+	}
+	if(overflowing(tree, node)) {
+		left = left_sibling(tree, node);
+		right = right_sibling(tree, node);
+		if(right != NULL && !near_overflowing(tree, right)) /* test: overflow_1 */
+			lr_redistribute(tree, node);
+		else if(left != NULL && !near_overflowing(tree, left)) /* test: overflow_2 */
+			rl_redistribute(tree, node);
+		else if(node->parent == NULL) { /* test: overflow_3 */
+			ret = newroot(tree);
+			if(ret == 0)
+				ret = split(tree, node);
+		}
+		else { /* test: overflow_4 */
+			ret = split(tree, node);
+			if(ret == 0)
+				ret = adjust(tree, node->parent);
+		}
+	}
+	else if(underflowing(tree, node)) {
+		left = left_sibling(tree, node);
+		right = right_sibling(tree, node);
+		if(left != NULL && !near_underflowing(tree, left)) /* test: underflow_1 */
+			lr_redistribute(tree, left);
+		else if(right != NULL && !near_underflowing(tree, right)) /* test: underflow_2 */
+			rl_redistribute(tree, right);
+		else if(node->parent == NULL) {
+			if(node->fill == 0 && !isleaf(node)) { /* test: underflow_3 */
+				tree->root = node->links[0].child;
+				tree->root->parent = NULL;
+				free_node(tree, node);
+			}
+		}
+		else if(right != NULL) { /* test: underflow_4 */
+			concatenate(tree, node);
+			adjust(tree, node->parent);
+		}
+		else { /* 'left' must exist */
+			concatenate(tree, left);
+			adjust(tree, left->parent);
+		}
+	}
+	return ret;
+}
+
+static void update_count(
+		btree_node_t *node,
+		btree_index_t amount)
+{
+	int i;
+	int ci;
+	while(node->parent != NULL) {
+		ci = node->child_index;
+		node = node->parent;
+		node->links[ci].count += amount;
+		for(i = ci + 1; i <= node->fill; i++)
+			node->links[i].offset += amount;
+	}
+}
+
+static int node_insert(
+		btree_t *tree,
+		btree_node_t *node,
+		int pos,
+		void *element)
+{
+	bool acquire = tree->hook_acquire != NULL && element != NULL;
+	int ret;
+
+	if((tree->options & BTREE_OPT_VAR_ELEMENTS) != 0 && element != NULL && tree->hook_length(tree, element) > (size_t)tree->element_size)
+		return -EINVAL;
+	if(tree->root == NULL) {
+		ret = newroot(tree);
+		if(ret != 0)
+			return ret;
+	}
+	if(node == NULL) {
+		node = tree->root;
+		pos = 0;
+	}
+	ret = leaf_open(tree, node);
+	if(ret != 0)
+		return ret;
+	if(node == &tree->small && node->fill >= small_capacity(tree)) { /* inline root is full, continue with a regular leaf */
+		ret = small_promote(tree);
+		if(ret != 0)
+			return ret;
+		node = tree->root;
+	}
+	if((tree->options & BTREE_OPT_VALUE_LOG) != 0) { /* the node receives a reference to a copy */
+		element = log_alloc(tree, element);
+		if(element == NULL)
+			return -ENOMEM;
+	}
+	if(pos == node_order(tree, node) - 1) { /* put new element into overflow position */
+		if(element == NULL)
+			CLEAR_EP(tree, tree->overflow_element);
+		else
+			SET_EP(tree, tree->overflow_element, element);
+		tree->overflow_node = node;
+	}
+	else {
+		if(near_overflowing(tree, node)) { /* node will overflow, move last element to overflow position */
+			memcpy(tree->overflow_element, node_element(tree, node, node->fill - 1), tree->element_size);
+			tree->overflow_node = node;
+			node->fill--;
+		}
+		open_position(tree, node, pos);
+		if(element == NULL)
+			CLEAR_EP(tree, node_element(tree, node, pos));
+		else
+			SET_EP(tree, node_element(tree, node, pos), element);
+		node->fill++;
+		node_inserted(tree, node, pos);
+	}
+
+	update_count(node, 1);
+	ret = adjust(tree, node);
+	if(ret != 0)
+		return ret;
+	if(acquire)
+		tree->hook_acquire(tree, element);
+	return 0;
+}
+
+static int node_replace(
+		btree_t *tree,
+		btree_node_t *node,
+		int pos,
+		void *element)
+{
+	bool acquire = tree->hook_acquire != NULL && element != NULL;
+	int ret;
+
+	if((tree->options & BTREE_OPT_VAR_ELEMENTS) != 0 && element != NULL && tree->hook_length(tree, element) > (size_t)tree->element_size)
+		return -EINVAL;
+	ret = leaf_open(tree, node);
+	if(ret != 0)
+		return ret;
+	if(tree->hook_release != NULL)
+		tree->hook_release(tree, GET_E(tree, node_element(tree, node, pos)));
+	if((tree->options & BTREE_OPT_VALUE_LOG) != 0) { /* overwrite the slot in place */
+		if(element == NULL)
+			memset(GET_E(tree, node_element(tree, node, pos)), 0, tree->log.value_size);
+		else
+			memcpy(GET_E(tree, node_element(tree, node, pos)), element, tree->log.value_size);
+		element = GET_E(tree, node_element(tree, node, pos));
+	}
+	else if(element == NULL)
+		CLEAR_EP(tree, node_element(tree, node, pos));
+	else
+		SET_EP(tree, node_element(tree, node, pos), element);
+	node_changed(tree, node);
+	if(paged(tree, node) && (ret = page_adjust(tree, node)) != 0) /* the element may take more or less bytes than the one replaced */
+		return ret;
+	if(acquire)
+		tree->hook_acquire(tree, element);
+	return 0;
+}
+
+/* TODO casual segfault when removing items from an even-order btree */
+static int node_remove(
+		btree_t *tree,
+		btree_node_t *node,
+		int pos)
+{
+	btree_node_t *cur = NULL;
+	int ret;
+
+	if(!isleaf(node)) { /* leftmost leaf of the right subtree, its first element replaces the removed one */
+		cur = node->links[pos + 1].child;
+		while(!isleaf(cur))
+			cur = cur->links[0].child;
+	}
+	if((ret = leaf_open(tree, node)) != 0 || (ret = leaf_open(tree, cur)) != 0)
+		return ret;
+	if(tree->hook_release != NULL)
+		tree->hook_release(tree, GET_E(tree, node_element(tree, node, pos)));
+	if((tree->options & BTREE_OPT_VALUE_LOG) != 0)
+		log_free(tree, GET_E(tree, node_element(tree, node, pos)));
+	if(isleaf(node)) { /* node where the element is contained within is a leaf, simply remove it */
+		close_position(tree, node, pos);
+		node->fill--;
+		if(node == tree->root && node->fill == 0) {
+			free_node(tree, node);
+			tree->root = NULL;
+			return 0;
+		}
+	}
+	else { /* node where the element is contained within is not a leaf, move up the first element of the right subtree */
+		memcpy(node_element(tree, node, pos), node_element(tree, cur, 0), tree->element_size); /* move first element to position of deleted element */
+		node_changed(tree, node);
+		close_position(tree, cur, 0); /* delete moved element */
+		cur->fill--;
+		node = cur;
+		pos = 0;
+	}
+	node_removed(tree, node, pos);
+	update_count(node, -1);
+	ret = adjust(tree, node);
+	if(ret == 0) /* half of the capacity, so that alternating insertions and removals don't move the elements every time */
+		small_demote(tree, small_capacity(tree) / 2);
+	return ret;
+}
+
+/* converts a node and a position to a position on a leaf, where
+ * a new element can be inserted, so that the resulting element
+ * will be located immediately before the given element */
+static void to_insert_before(
+		btree_t *tree,
+		btree_node_t **node,
+		btree_index_t *pos)
+{
+	if(*node == NULL) { /* rightmost position in tree; find_lower returns NULL is all elements are less, therefore insertion would take place at rightmost slot */
+		if(tree->root == NULL) /* no root node yet, *node remains NULL */
+			return;
+		*node = tree->root;
+		*pos = tree->root->fill;
+	}
+	while(!isleaf(*node)) {
+		*node = (*node)->links[*pos].child;
+		*pos = (*node)->fill;
+	}
+}
+
+/* converts a node and a position to a position on a leaf, where
+ * a new element can be inserted, so that the resulting element
+ * will be located immediately after the given element */
+/*static void to_insert_after(
+		btree_t *tree,
+		btree_node_t **node,
+		int *pos)
+{
+	if(*node == NULL) {
+		if(tree->root == NULL)
+			return;
+		*node = tree->root;
+		*pos = -1;
+	}
+	while(!isleaf(*node)) {
+		*node = (*node)->links[*pos + 1].child;
+		*pos = -1;
+	}
+	(*pos)++;
+}*/
+
+static int subtree_pos(
+		btree_node_t *node,
+		btree_index_t index)
+{
+	int l = 0;
+	int u = node->fill;
+	btree_index_t o;
+	btree_index_t c;
+	int m;
+
+	if(isleaf(node))
+		return index >= 0 && index <= node->fill ? index : -1;
+	while(l <= u) {
+		m = l + (u - l) / 2;
+		c = node->links[m].count;
+		o = node->links[m].offset;
+		if(o > index)
+			u = m - 1;
+		else if(o + c < index)
+			l = m + 1;
+		else
+			return m;
+	}
+	return -1;
+}
+
+/* binary search of the sorted elements [l, u) of a static layout for the first
+ * position whose element is not less than 'key' (greater than 'key' if 'upper') */
+static btree_index_t static_bound(
+		btree_t *tree,
+		btree_index_t l,
+		btree_index_t u,
+		const void *key,
+		void *group,
+		btree_cmp_t cmpfn,
+		bool upper)
+{
+	void *elements = tree->layout.root.elements;
+	btree_index_t m;
+	int cmp;
+
+	while(l < u) {
+		m = l + (u - l) / 2;
+		cmp = cmpfn(tree, GET_E(tree, elements + (size_t)m * tree->element_size), key, group);
+		if(upper ? cmp > 0 : cmp >= 0)
+			u = m;
+		else
+			l = m + 1;
+	}
+	return l;
+}
+
+/* whether the element of a static layout at 'pos' equals 'key' */
+static bool static_equal(
+		btree_t *tree,
+		btree_index_t pos,
+		const void *key,
+		void *group,
+		btree_cmp_t cmpfn)
+{
+	return cmpfn(tree, GET_E(tree, tree->layout.root.elements + (size_t)pos * tree->element_size), key, group) == 0;
+}
+
+/* search within a static layout; see find_lower()/find_upper() for arguments */
+static bool static_find(
+		btree_t *tree,
+		const void *key,
+		btree_node_t **node,
+		btree_index_t *pos,
+		void *group,
+		btree_cmp_t cmpfn,
+		bool upper)
+{
+	btree_index_t n = tree->layout.root.fill;
+	btree_index_t n_samples = tree->layout.n_samples;
+	void *samples = tree->layout.samples;
+	btree_index_t l = 0;
+	btree_index_t u = n;
+	btree_index_t i = 1;
+	int cmp;
+
+	if(n_samples > 0) {
+		/* descend the implicit tree of samples; the index of the first sample not
+		 * matching is encoded in the path taken (see Khuong and Morin, "Array layouts
+		 * for comparison-based searching") */
+		while(i <= n_samples) {
+			if(16 * i <= n_samples) { /* the 16 descendants four levels down are adjacent, fetch them ahead */
+				__builtin_prefetch(samples + (size_t)(16 * i) * tree->element_size);
+				__builtin_prefetch(samples + (size_t)(16 * i) * tree->element_size + 64);
+			}
+			cmp = cmpfn(tree, GET_E(tree, samples + (size_t)i * tree->element_size), key, group);
+			i = 2 * i + (upper ? cmp <= 0 : cmp < 0);
+		}
+		i >>= __builtin_ffsll(~(long long)i);
+		/* result is after the last sample before it and at most the sample found */
+		if(i == 0)
+			l = (n_samples - 1) * tree->layout.block + 1;
+		else {
+			u = tree->layout.ranks[i];
+			l = MAX(u - tree->layout.block + 1, 0);
+		}
+	}
+	l = static_bound(tree, l, u, key, group, cmpfn, upper);
+
+	if(node != NULL)
+		*node = &tree->layout.root;
+	if(pos != NULL)
+		*pos = l;
+	if(upper)
+		return l > 0 && static_equal(tree, l - 1, key, group, cmpfn);
+	else
+		return l < n && static_equal(tree, l, key, group, cmpfn);
+}
+
+/* static_find() restricted to the indices [loff, uoff), see find_lower_in() */
+static bool static_find_in(
+		btree_t *tree,
+		btree_index_t loff,
+		btree_index_t uoff,
+		const void *key,
+		btree_node_t **node,
+		btree_index_t *pos,
+		void *group,
+		btree_cmp_t cmpfn,
+		bool upper)
+{
+	btree_index_t u = MAX(MIN(uoff, tree->layout.root.fill), 0);
+	btree_index_t l = MIN(MAX(loff, 0), u);
+	btree_index_t m = static_bound(tree, l, u, key, group, cmpfn, upper);
+
+	if(node != NULL)
+		*node = &tree->layout.root;
+	if(pos != NULL)
+		*pos = m;
+	if(upper)
+		return m > l && static_equal(tree, m - 1, key, group, cmpfn);
+	else
+		return m < u && static_equal(tree, m, key, group, cmpfn);
+}
+
+/* start fetching 'node' (may be NULL) as soon as it is known to be searched
+ * next, so that its lines arrive in parallel instead of one after another
+ * as the search compares them. used by batched lookups, whose descents
+ * overlap their misses this way (see btree_get_many()) */
+static inline void fetch_node(
+		btree_t *tree,
+		const btree_node_t *node)
+{
+	int i;
+
+	if(node != NULL)
+		for(i = 0; i < tree->n_prefetch; i++)
+			__builtin_prefetch((const char*)node + tree->prefetch[i]);
+}
+
+/* first position within [l, u) of 'node' whose element is not less than 'key'
+ * (greater than 'key' if 'upper'). 'equal' (may be NULL) is set if the element
+ * at (before if 'upper') that position within [l, u) equals 'key'.
+ * the element deciding 'equal' is the last one compared which ended up on
+ * the side of the bound given by 'upper', so that no extra comparison is needed */
+static int node_bound(
+		btree_t *tree,
+		btree_node_t *node,
+		int l,
+		int u,
+		const void *key,
+		void *group,
+		btree_cmp_t cmpfn,
+		const search_key_t *q,
+		bool upper,
+		bool *equal)
+{
+	bool eq = false;
+	bool right; /* bound is right of the element compared */
+	int m;
+	int n;
+	int cmp;
+
+	if(q->mode == SEARCH_INT) { /* the keys are sorted, count those before the bound */
+		m = MAX(l, tree->int_count(node_cache(tree, node), u, q->key, upper));
+		if(equal != NULL && upper)
+			*equal = m > l && key_cmp(tree, node, m - 1, key, group, cmpfn, q) == 0;
+		else if(equal != NULL)
+			*equal = m < u && key_cmp(tree, node, m, key, group, cmpfn, q) == 0;
+		return m;
+	}
+	switch(tree->search) {
+	case BTREE_SEARCH_LINEAR:
+		for(; l < u; l++) {
+			cmp = key_cmp(tree, node, l, key, group, cmpfn, q);
+			right = cmp < 0 || (cmp == 0 && upper);
+			if(right == upper)
+				eq = cmp == 0;
+			if(!right)
+				break;
+		}
+		break;
+	case BTREE_SEARCH_BRANCHLESS: /* the same steps for both outcomes, selected by conditional moves */
+		for(n = u - l; n > 0; ) {
+			m = l + n / 2;
+			cmp = key_cmp(tree, node, m, key, group, cmpfn, q);
+			right = cmp < 0 || (cmp == 0 && upper);
+			eq = right == upper ? cmp == 0 : eq;
+			l = right ? m + 1 : l;
+			n = right ? n - n / 2 - 1 : n / 2;
+		}
+		break;
+	default:
+		while(l < u) {
+			m = l + (u - l) / 2;
+			cmp = key_cmp(tree, node, m, key, group, cmpfn, q);
+			right = cmp < 0 || (cmp == 0 && upper);
+			if(right == upper)
+				eq = cmp == 0;
+			if(right)
+				l = m + 1;
+			else
+				u = m;
+		}
+		break;
+	}
+	if(equal != NULL)
+		*equal = eq;
+	return l;
+}
+
+/* first link of an interior node whose subtree, including the element
+ * following it, reaches index 'index' (relative to the node); fill + 1 if none */
+static int link_bound(
+		btree_t *tree,
+		btree_node_t *node,
+		btree_index_t index)
+{
+	const btree_link_t *links = node->links;
+	bool right;
+	int l = 0;
+	int u = node->fill + 1;
+	int m;
+	int n;
+
+	switch(tree->link_search) {
+	case BTREE_SEARCH_LINEAR:
+		while(l < u && links[l].offset + links[l].count < index)
+			l++;
+		break;
+	case BTREE_SEARCH_BRANCHLESS:
+		for(n = u; n > 0; ) {
+			m = l + n / 2;
+			right = links[m].offset + links[m].count < index;
+			l = right ? m + 1 : l;
+			n = right ? n - n / 2 - 1 : n / 2;
+		}
+		break;
+	default:
+		while(l < u) {
+			m = l + (u - l) / 2;
+			if(links[m].offset + links[m].count < index)
+				l = m + 1;
+			else
+				u = m;
+		}
+		break;
+	}
+	return l;
+}
+
+static bool find_lower(
+		btree_t *tree,
+		const void *key,
+		btree_node_t **node,
+		btree_index_t *pos,
+		void *group,
+		btree_cmp_t cmpfn)
+{
+	int u;
+	int l;
+	bool eq;
+	btree_node_t *node_candidate = NULL;
+	btree_index_t pos_candidate = 0;
+	bool found = false;
+	btree_node_t *cur = tree->root;
+	btree_node_t *prev = NULL;
+	search_key_t q;
+
+	if(isstatic(tree))
+		return static_find(tree, key, node, pos, group, cmpfn, false);
+	search_key_init(tree, key, cmpfn, &q);
+	while(cur != NULL) {
+		u = cur->fill - 1;
+		l = 0;
+		prev = cur;
+		search_key_node(tree, cur, &q);
+		l = node_bound(tree, cur, l, u + 1, key, group, cmpfn, &q, false, &eq);
+		if(l <= u) {
+			node_candidate = cur;
+			pos_candidate = l;
+			found = found || eq;
+		}
+		cur = link_child(cur, l);
+	}
+
+	if(node_candidate == NULL && prev != NULL) { /* all element keys less than requested key, select imaginary element after end (rightmost leaf node) */
+		node_candidate = prev;
+		pos_candidate = prev->fill;
+	}
+	if(node != NULL)
+		*node = node_candidate;
+	if(pos != NULL)
+		*pos = pos_candidate;
+	return found;
+}
+
+/* find_lower() restricted to the indices [loff, uoff) */
+static bool find_lower_in(
+		btree_t *tree,
+		btree_index_t loff,
+		btree_index_t uoff,
+		const void *key,
+		btree_node_t **node,
+		btree_index_t *pos,
+		void *group,
+		btree_cmp_t cmpfn)
+{
+	int u;
+	int l;
+	bool eq;
+	btree_node_t *node_candidate = NULL;
+	btree_index_t pos_candidate = 0;
+	bool found = false;
+	btree_node_t *cur = tree->root;
+	btree_node_t *prev = NULL;
+	search_key_t q;
+	int prev_u;
+	btree_index_t offset = 0;
+
+	if(isstatic(tree))
+		return static_find_in(tree, loff, uoff, key, node, pos, group, cmpfn, false);
+	search_key_init(tree, key, cmpfn, &q);
+	while(cur != NULL) {
+		if(loff <= offset)
+			l = 0;
+		else
+			l = subtree_pos(cur, loff - offset);
+		if(uoff >= offset + link_offset(cur, cur->fill))
+			u = cur->fill;
+		else
+			u = subtree_pos(cur, uoff - offset);
+		prev = cur;
+		search_key_node(tree, cur, &q);
+		prev_u = u;
+		u--;
+		l = node_bound(tree, cur, l, u + 1, key, group, cmpfn, &q, false, &eq);
+		if(l <= u) {
+			node_candidate = cur;
+			pos_candidate = l;
+			found = found || eq;
+		}
+		offset += link_offset(cur, l);
+		cur = link_child(cur, l);
+	}
+	if(node_candidate == NULL && prev != NULL) { /* all element keys less than requested key, select imaginary element after end (rightmost leaf node) */
+		node_candidate = prev;
+		pos_candidate = prev_u;
+	}
+	if(node != NULL)
+		*node = node_candidate;
+	if(pos != NULL)
+		*pos = pos_candidate;
+	return found;
+}
+
+static bool find_upper(
+		btree_t *tree,
+		const void *key,
+		btree_node_t **node,
+		btree_index_t *pos,
+		void *group,
+		btree_cmp_t cmpfn)
+{
+	int u;
+	int l;
+	bool eq;
+	btree_node_t *node_candidate = NULL;
+	btree_index_t pos_candidate = 0;
+	bool found = false;
+	btree_node_t *cur = tree->root;
+	btree_node_t *prev = NULL;
+	search_key_t q;
+
+	if(isstatic(tree))
+		return static_find(tree, key, node, pos, group, cmpfn, true);
+	search_key_init(tree, key, cmpfn, &q);
+	while(cur != NULL) {
+		u = cur->fill - 1;
+		l = 0;
+		prev = cur;
+		search_key_node(tree, cur, &q);
+		l = node_bound(tree, cur, l, u + 1, key, group, cmpfn, &q, true, &eq);
+		if(l <= u) {
+			node_candidate = cur;
+			pos_candidate = l;
+		}
+		found = found || eq;
+		cur = link_child(cur, l);
+	}
+
+	if(node_candidate == NULL && prev != NULL) { /* all element keys less than requested key, select imaginary element after end (rightmost leaf node) */
+		node_candidate = prev;
+		pos_candidate = prev->fill;
+	}
+	if(node != NULL)
+		*node = node_candidate;
+	if(pos != NULL)
+		*pos = pos_candidate;
+	return found;
+}
+
+/* find_upper() restricted to the indices [loff, uoff) */
+static bool find_upper_in(
+		btree_t *tree,
+		btree_index_t loff,
+		btree_index_t uoff,
+		const void *key,
+		btree_node_t **node,
+		btree_index_t *pos,
+		void *group,
+		btree_cmp_t cmpfn)
+{
+	int u;
+	int l;
+	bool eq;
+	btree_node_t *node_candidate = NULL;
+	btree_index_t pos_candidate = 0;
+	bool found = false;
+	btree_node_t *cur = tree->root;
+	btree_node_t *prev = NULL;
+	search_key_t q;
+	int prev_u;
+	btree_index_t offset = 0;
+
+	if(isstatic(tree))
+		return static_find_in(tree, loff, uoff, key, node, pos, group, cmpfn, true);
+	search_key_init(tree, key, cmpfn, &q);
+	while(cur != NULL) {
+		if(loff <= offset)
+			l = 0;
+		else {
+			l = subtree_pos(cur, loff - offset);
+			assert(l <= cur->fill);
+			assert(l >= 0);
+		}
+		if(uoff >= offset + link_offset(cur, cur->fill))
+			u = cur->fill;
+		else {
+			u = subtree_pos(cur, uoff - offset);
+			assert(u <= cur->fill);
+			assert(u >= 0);
+		}
+		prev = cur;
+		search_key_node(tree, cur, &q);
+		prev_u = u;
+		u--;
+		l = node_bound(tree, cur, l, u + 1, key, group, cmpfn, &q, true, &eq);
+		if(l <= u) {
+			node_candidate = cur;
+			pos_candidate = l;
+		}
+		found = found || eq;
+		offset += link_offset(cur, l);
+		cur = link_child(cur, l);
+	}
+
+	if(node_candidate == NULL && prev != NULL) { /* all element keys less than requested key, select imaginary element after end (rightmost leaf node) */
+		node_candidate = prev;
+		pos_candidate = prev_u;
+	}
+	if(node != NULL)
+		*node = node_candidate;
+	if(pos != NULL)
+		*pos = pos_candidate;
+	return found;
+}
+
+/* find_lower()/find_upper() starting at the position given by 'node' and
+ * 'pos' instead of the root: climb only until the bound is known to be within
+ * the subtree of a node or the element following that subtree, then descend
+ * from there. a side once known remains so while climbing, as the subtree
+ * only grows. costs O(log d) comparisons for a bound d elements away */
+static bool seek_bound(
+		btree_t *tree,
+		const void *key,
+		btree_node_t **node,
+		btree_index_t *pos,
+		void *group,
+		btree_cmp_t cmpfn,
+		bool upper)
+{
+	bool left = false; /* the elements before the subtree of 'cur' are before the bound */
+	bool right = false; /* the bound is at most the element following the subtree of 'cur' */
+	bool within = false; /* bound found within the subtree */
+	bool eq;
+	int l;
+	int cmp;
+	btree_node_t *node_candidate = NULL;
+	btree_index_t pos_candidate = 0;
+	bool found = false;
+	btree_node_t *cur = *node;
+	btree_node_t *parent;
+	btree_node_t *prev = NULL;
+	search_key_t q;
+
+	if(cur == NULL || isstatic(tree)) /* no position or no parents to climb */
+		return upper ? find_upper(tree, key, node, pos, group, cmpfn) : find_lower(tree, key, node, pos, group, cmpfn);
+	search_key_init(tree, key, cmpfn, &q);
+	while(cur->parent != NULL && !(left && right)) {
+		parent = cur->parent;
+		search_key_node(tree, parent, &q);
+		if(!left && cur->child_index > 0) {
+			cmp = key_cmp(tree, parent, cur->child_index - 1, key, group, cmpfn, &q);
+			left = upper ? cmp <= 0 : cmp < 0;
+			found = found || (upper && cmp == 0);
+		}
+		if(!right && cur->child_index < parent->fill) {
+			cmp = key_cmp(tree, parent, cur->child_index, key, group, cmpfn, &q);
+			right = upper ? cmp > 0 : cmp >= 0;
+		}
+		if(!(left && right))
+			cur = parent;
+	}
+
+	/* the element following the subtree, unless the bound is found within */
+	for(parent = cur; parent->parent != NULL && parent->child_index == parent->parent->fill; parent = parent->parent);
+	if(parent->parent != NULL) {
+		node_candidate = parent->parent;
+		pos_candidate = parent->child_index;
+	}
+	while(cur != NULL) {
+		prev = cur;
+		search_key_node(tree, cur, &q);
+		l = node_bound(tree, cur, 0, cur->fill, key, group, cmpfn, &q, upper, &eq);
+		if(l < cur->fill) {
+			node_candidate = cur;
+			pos_candidate = l;
+			within = true;
+		}
+		found = found || eq;
+		cur = link_child(cur, l);
+	}
+
+	if(node_candidate == NULL) { /* all element keys less than requested key, select imaginary element after end (rightmost leaf node) */
+		node_candidate = prev;
+		pos_candidate = prev->fill;
+	}
+	else if(!within && !upper) { /* the element following the subtree is the bound */
+		search_key_node(tree, node_candidate, &q);
+		found = key_cmp(tree, node_candidate, pos_candidate, key, group, cmpfn, &q) == 0;
+	}
+	*node = node_candidate;
+	*pos = pos_candidate;
+	return found;
+}
+
+
+/* number of elements within the subtree of 'node' which are less than 'key'
+ * (not greater than 'key' if 'upper') */
+static btree_index_t subtree_rank(
+		btree_t *tree,
+		btree_node_t *node,
+		const void *key,
+		void *group,
+		btree_cmp_t cmpfn,
+		search_key_t *q,
+		bool upper)
+{
+	btree_index_t rank = 0;
+	int pos;
+
+	while(node != NULL) {
+		search_key_node(tree, node, q);
+		pos = node_bound(tree, node, 0, node->fill, key, group, cmpfn, q, upper, NULL);
+		rank += link_offset(node, pos);
+		node = link_child(node, pos);
+	}
+	return rank;
+}
+
+/* returns whether the given index has been found. if false:
+ *   - 'node' == NULL: given index greater than size
+ *   - 'node' != NULL: given index == size, can append at node->elements[pos] (note: 'pos' may be the overflow position) */
+static bool find_index(
+		btree_t *tree,
+		btree_index_t index,
+		btree_node_t **node,
+		btree_index_t *pos)
+{
+	btree_index_t m;
+	btree_node_t *cur = tree->root;
+	btree_index_t offset = 0;
+
+	while(cur != NULL) {
+		if(isleaf(cur)) /* elements are consecutive */
+			m = index - offset < 0 || index - offset > cur->fill ? cur->fill + 1 : index - offset;
+		else
+			m = link_bound(tree, cur, index - offset);
+		if(m > cur->fill)
+			break;
+		else if(link_offset(cur, m) + link_count(cur, m) == index - offset && (m < cur->fill || isleaf(cur))) {
+			if(node != NULL)
+				*node = cur;
+			if(pos != NULL)
+				*pos = m;
+			return m < cur->fill;
+		}
+		offset += link_offset(cur, m); /* index is within the subtree, or appended to the last one */
+		cur = cur->links[m].child;
+	}
+	if(node != NULL)
+		*node = NULL;
+	if(pos != NULL)
+		*pos = 0;
+	return false;
+}
+
+static btree_index_t to_index(
+		btree_node_t *node,
+		btree_index_t pos)
+{
+	btree_index_t index;
+
+	if(node == NULL)
+		return 0;
+	index = link_count(node, pos);
+	while(node != NULL) {
+		index += link_offset(node, pos);
+		pos = node->child_index;
+		node = node->parent;
+	}
+	return index;
+}
+
+static bool to_next(
+		btree_node_t **node_,
+		btree_index_t *pos_)
+{
+	btree_node_t *node = *node_;
+	btree_index_t pos = *pos_;
+
+	if(pos == node->fill)
+		return false;
+	pos++;
+	/* descend */
+	while(link_child(node, pos) != NULL) {
+		node = node->links[pos].child;
+		pos = 0;
+	}
+	/* ascend */
+	while(pos == node->fill) {
+		pos = node->child_index;
+		node = node->parent;
+		if(node == NULL) { /* end reached */
+			(*pos_)++; /* if we are here, *node_ is rightmost leaf. increase pos_ so that it points to imaginary element after end. */
+			return true;
+		}
+	}
+	*node_ = node;
+	*pos_ = pos;
+	return true;
+}
+
+static bool to_prev(
+		btree_node_t **node_,
+		btree_index_t *pos_)
+{
+	btree_node_t *node = *node_;
+	btree_index_t pos = *pos_;
+
+	/* descend tree */
+	while(link_child(node, pos) != NULL) {
+		node = node->links[pos].child;
+		pos = node->fill;
+	}
+	/* ascend tree */
+	while(pos == 0) {
+		pos = node->child_index;
+		node = node->parent;
+		if(node == NULL)
+			return false;
+	}
+	pos--;
+	*node_ = node;
+	*pos_ = pos;
+	return true;
+}
+
+/* check, whether the specified element can be inserted/set at given index */
+static bool validate_at(
+		btree_t *tree,
+		const void *element,
+		btree_node_t *node,
+		btree_index_t pos,
+		bool replace)
+{
+	btree_node_t *other_node;
+	btree_index_t other_pos;
+	bool found;
+
+	/* TODO debug. if !node, a segfault happens (i.e. when validating against an empty tree). */
+	return true;
+
+
+	other_node = node;
+	other_pos = pos;
+	found = to_prev(&other_node, &other_pos);
+	if(found && tree->hook_cmp(tree, GET_E(tree, node_element(tree, other_node, other_pos)), element_key(tree, element), tree->group_default) > 0) /* element before must be <= element to insert */
+		return false;
+	if(replace) {
+		other_node = node;
+		other_pos = pos;
+		found = to_next(&other_node, &other_pos);
+	}
+	else {
+		other_node = node;
+		other_pos = pos;
+		found = pos < node->fill;
+	}
+	if(found && tree->hook_cmp(tree, GET_E(tree, node_element(tree, other_node, other_pos)), element_key(tree, element), tree->group_default) < 0) /* element after must be >= element to insert */
+		return false;
+	return true;
+}
+
+btree_t *btree_new(
+		int order,
+		int element_size,
+		int (*cmp)(btree_t *btree, const void *a, const void *b, void *group),
+		int options)
+{
+	btree_params_t params;
+
+	memset(&params, 0, sizeof(params));
+	params.order = order;
+	params.element_size = element_size;
+	params.cmp = cmp;
+	params.options = options;
+	return btree_new_ex(&params);
+}
+
+btree_t *btree_new_ex(
+		const btree_params_t *params)
+{
+	static const btree_allocator_t default_allocator = { default_alloc, default_free, NULL };
+	const btree_allocator_t *allocator = params->allocator;
+	size_t node_align = NODE_ALIGN;
+	size_t element_align = 1;
+	int element_size = params->element_size < 0 || (params->options & BTREE_OPT_VALUE_LOG) != 0 ? (int)sizeof(void*) : params->element_size; /* of the node elements */
+	int small_max = 0;
+	size_t leaf_bytes = 0;
+	size_t record = 0; /* bytes an element takes within a leaf page at most (string keys: on average) */
+	size_t page_min = 0;
+	btree_t *self;
+
+	if(params->node_align == BTREE_ALIGN_PAGE)
+		node_align = sysconf(_SC_PAGESIZE);
+	else if(params->node_align > 0)
+		node_align = MAX(NODE_ALIGN, (size_t)params->node_align);
+	if(params->element_align > 0)
+		element_align = params->element_align;
+	node_align = MAX(node_align, element_align); /* element offsets are relative to the node */
+	if((params->options & BTREE_OPT_VAR_ELEMENTS) != 0 && params->element_size > 0)
+		record = sizeof(page_slot_t) + ALIGN_UP((size_t)params->element_size, element_align);
+	else if((params->options & BTREE_OPT_STRING_KEYS) != 0) /* as many key bytes as interior nodes keep */
+		record = sizeof(page_slot_t) + STRING_WINDOW + 1;
+	if(record > 0) { /* a page holds at least PAGE_MIN_ELEMENTS elements */
+		page_min = PAGE_MIN_ELEMENTS * record;
+		if(params->leaf_bytes > 0)
+			leaf_bytes = params->leaf_bytes;
+		else if(params->leaf_order > 0) /* as many bytes as the elements take */
+			leaf_bytes = MIN(MAX((params->leaf_order - 1) * record, page_min), ALIGN_DOWN(UINT16_MAX, element_align));
+		else
+			leaf_bytes = MAX((size_t)PAGE_BYTES, page_min);
+	}
+
+	if(params->order < 3) {
+		errno = EINVAL;
+		return NULL;
+	}
+	else if(params->order % 2 == 0) { /* TODO there is a bug when removing an entry from an even-order btree. prevent using even order. */
+		errno = EINVAL;
+		return NULL;
+	}
+	else if(params->leaf_order != 0 && (params->leaf_order < 3 || params->leaf_order % 2 == 0)) { /* same restrictions as for 'order' */
+		errno = EINVAL;
+		return NULL;
+	}
+	else if((params->options & BTREE_OPT_RESERVED) != 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+	else if((node_align & (node_align - 1)) != 0 || (element_align & (element_align - 1)) != 0 || params->node_align < BTREE_ALIGN_PAGE) { /* alignments must be powers of two */
+		errno = EINVAL;
+		return NULL;
+	}
+	else if(params->element_size > 0 && params->element_size % element_align != 0) { /* every element within the array must be aligned */
+		errno = EINVAL;
+		return NULL;
+	}
+	else if(allocator != NULL && (allocator->alloc == NULL || allocator->free == NULL)) {
+		errno = EINVAL;
+		return NULL;
+	}
+	else if((params->options & BTREE_OPT_SHARED_POOL) != 0 && (allocator != NULL || (params->options & (BTREE_OPT_ARENA | BTREE_OPT_HUGE_PAGES)) != 0)) { /* shared nodes migrate between trees */
+		errno = EINVAL;
+		return NULL;
+	}
+	else if(((params->options & BTREE_OPT_STRING_KEYS) != 0) != (params->string_key != NULL) || (params->string_key != NULL && params->cmp != NULL)) { /* string keys define the order */
+		errno = EINVAL;
+		return NULL;
+	}
+	else if((params->options & BTREE_OPT_KEY_COLUMN) != 0 && (params->cmp == NULL || (params->options & BTREE_OPT_STRING_KEYS) != 0 || params->key_size <= 0 || params->key_offset < 0 ||
+				(params->element_size > 0 && params->key_offset + params->key_size > params->element_size))) {
+		errno = EINVAL;
+		return NULL;
+	}
+	else if((params->options & BTREE_OPT_PACKED_LEAVES) != 0 && (params->cmp != NULL || params->element_size < (int)sizeof(int64_t) || (params->options & BTREE_OPT_STRING_KEYS) != 0)) { /* the integer keys define the order */
+		errno = EINVAL;
+		return NULL;
+	}
+	else if((params->options & BTREE_OPT_DUP_RUNS) != 0 && ((params->options & BTREE_OPT_MULTI_KEY) == 0 || params->cmp == NULL || params->element_size <= 0 ||
+				(params->options & (BTREE_OPT_STRING_KEYS | BTREE_OPT_KEY_COLUMN | BTREE_OPT_PACKED_LEAVES)) != 0 ||
+				params->key_size <= 0 || params->key_offset < 0 || params->key_offset + params->key_size > params->element_size ||
+				(params->leaf_order == 0 ? params->order : params->leaf_order) - 1 > UINT16_MAX)) { /* run ends are 16 bit */
+		errno = EINVAL;
+		return NULL;
+	}
+	else if(((params->options & BTREE_OPT_VAR_ELEMENTS) != 0) != (params->element_length != NULL) || (params->element_length != NULL && (params->element_size <= 0 ||
+				(params->options & (BTREE_OPT_STRING_KEYS | BTREE_OPT_KEY_COLUMN | BTREE_OPT_PACKED_LEAVES | BTREE_OPT_DUP_RUNS)) != 0))) {
+		errno = EINVAL;
+		return NULL;
+	}
+	else if(params->leaf_bytes != 0 && (params->leaf_bytes < 0 || (params->options & (BTREE_OPT_VAR_ELEMENTS | BTREE_OPT_STRING_KEYS)) == 0 || leaf_bytes < page_min)) { /* see PAGE_MIN_ELEMENTS */
+		errno = EINVAL;
+		return NULL;
+	}
+	else if(leaf_bytes > UINT16_MAX) { /* slots are 16 bit */
+		errno = EINVAL;
+		return NULL;
+	}
+	else if((params->options & BTREE_OPT_VALUE_LOG) != 0 && (params->element_size <= 0 || (params->options & (BTREE_OPT_PACKED_LEAVES | BTREE_OPT_DUP_RUNS | BTREE_OPT_VAR_ELEMENTS)) != 0)) { /* those need the elements within the nodes */
+		errno = EINVAL;
+		return NULL;
+	}
+	else if(((params->options & BTREE_OPT_KEY_PREFIX) != 0) != (params->key_prefix != NULL) || (params->key_prefix != NULL && (params->cmp == NULL ||
+				(params->options & (BTREE_OPT_STRING_KEYS | BTREE_OPT_KEY_COLUMN | BTREE_OPT_PACKED_LEAVES | BTREE_OPT_DUP_RUNS | BTREE_OPT_VAR_ELEMENTS)) != 0))) { /* those keep other data within the nodes */
+		errno = EINVAL;
+		return NULL;
+	}
+	else if(params->key_type != BTREE_KEY_NONE && (params->key_type < BTREE_KEY_INT32 || params->key_type > BTREE_KEY_UINT64 || params->cmp != NULL || params->string_key != NULL ||
+				(params->options & (BTREE_OPT_KEY_COLUMN | BTREE_OPT_PACKED_LEAVES | BTREE_OPT_DUP_RUNS | BTREE_OPT_VAR_ELEMENTS | BTREE_OPT_KEY_PREFIX)) != 0 || params->key_offset < 0 ||
+				(params->element_size > 0 && params->key_offset + (params->key_type == BTREE_KEY_INT32 ? (int)sizeof(int32_t) : (int)sizeof(int64_t)) > params->element_size))) { /* the keys define the order */
+		errno = EINVAL;
+		return NULL;
+	}
+	else if((params->options & BTREE_OPT_PERMUTED_LEAVES) != 0 && (params->element_size <= 0 ||
+				(params->options & (BTREE_OPT_STRING_KEYS | BTREE_OPT_PACKED_LEAVES | BTREE_OPT_DUP_RUNS | BTREE_OPT_VAR_ELEMENTS | BTREE_OPT_VALUE_LOG)) != 0 ||
+				(params->leaf_order == 0 ? params->order : params->leaf_order) - 1 > UINT8_MAX + 1)) { /* slot indices are single bytes */
+		errno = EINVAL;
+		return NULL;
+	}
+	else if(params->search < BTREE_SEARCH_AUTO || params->search > BTREE_SEARCH_LINEAR) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if(allocator == NULL)
+		allocator = &default_allocator;
+	if((params->options & (BTREE_OPT_STRING_KEYS | BTREE_OPT_KEY_COLUMN | BTREE_OPT_PACKED_LEAVES | BTREE_OPT_DUP_RUNS | BTREE_OPT_VAR_ELEMENTS | BTREE_OPT_KEY_PREFIX | BTREE_OPT_PERMUTED_LEAVES)) == 0 && params->key_type == BTREE_KEY_NONE && element_size > 0) /* those keep search data or slot indices within the nodes */
+		small_max = MIN(SMALL_ELEMENTS, SMALL_BYTES / element_size);
+	self = alloc_tree(allocator, element_size, element_align, small_max);
+	if(self == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	self->options = params->options;
+	if((self->options & BTREE_OPT_HUGE_PAGES) != 0)
+		self->options |= BTREE_OPT_ARENA;
+	self->order = params->order;
+	if(params->leaf_order != 0)
+		self->leaf_order = params->leaf_order;
+	else if(leaf_bytes > 0 && (params->options & BTREE_OPT_STRING_KEYS) != 0) /* the bytes bound leaves, their elements take no more */
+		self->leaf_order = MAX(3, (int)MIN(leaf_bytes / record, leaf_bytes / element_size) | 1);
+	else if(leaf_bytes > 0) /* BTREE_OPT_VAR_ELEMENTS: the bytes bound leaves, allow for elements of a quarter of the maximum */
+		self->leaf_order = MAX(3, (int)(leaf_bytes / (sizeof(page_slot_t) + ALIGN_UP((size_t)element_size / 4, element_align))) | 1);
+	else
+		self->leaf_order = params->order;
+	self->leaf_bytes = leaf_bytes;
+	self->hook_cmp = params->cmp;
+	if(params->string_key != NULL) {
+		self->hook_string = params->string_key;
+		self->hook_cmp = string_cmp;
+	}
+	else if((params->options & BTREE_OPT_KEY_COLUMN) != 0) {
+		self->hook_key_cmp = params->cmp;
+		self->hook_cmp = column_cmp;
+		self->key_size = params->key_size;
+		self->key_offset = params->key_offset;
+	}
+	else if((params->options & BTREE_OPT_PACKED_LEAVES) != 0)
+		self->hook_cmp = packed_cmp;
+	else if(params->key_type != BTREE_KEY_NONE) {
+		self->hook_cmp = int_cmp;
+		self->key_type = params->key_type;
+		self->key_size = params->key_type == BTREE_KEY_INT32 ? sizeof(int32_t) : sizeof(int64_t);
+		self->key_offset = params->key_offset;
+		self->int_count = int_kernel(params->key_type);
+	}
+	if((params->options & BTREE_OPT_DUP_RUNS) != 0) {
+		self->key_size = params->key_size;
+		self->key_offset = params->key_offset;
+	}
+	self->hook_length = params->element_length;
+	self->hook_prefix = params->key_prefix;
+	if(params->element_size < 0) {
+		self->element_size = sizeof(void*);
+		self->options |= OPT_USE_POINTERS;
+	}
+	else if((params->options & BTREE_OPT_VALUE_LOG) != 0) { /* nodes store pointers to the slots */
+		self->log.value_size = params->element_size;
+		self->log.slot_size = ALIGN_UP(MAX((size_t)params->element_size, sizeof(void*)), element_align);
+		for(self->log.chunk_size = LOG_CHUNK; self->log.chunk_size < ALIGN_UP(CHUNK_HEADER, element_align) + self->log.slot_size; self->log.chunk_size *= 2);
+		self->element_size = sizeof(void*);
+		self->options |= OPT_USE_POINTERS;
+	}
+	else
+		self->element_size = params->element_size;
+	if(self->hook_cmp == NULL)
+		self->options |= OPT_NOCMP;
+	if(params->arena_chunk == 0)
+		self->arena.chunk_size = ARENA_CHUNK_DEFAULT;
+	else
+		self->arena.chunk_size = params->arena_chunk;
+	if((self->options & BTREE_OPT_HUGE_PAGES) != 0)
+		self->arena.chunk_size = ALIGN_UP(self->arena.chunk_size, HUGE_PAGE_SIZE);
+	self->node_align = node_align;
+	self->search_param = params->search;
+	setup_layout(self);
+	choose_search(self);
+	if((self->options & BTREE_OPT_SHARED_POOL) != 0) {
+		self->shared[NODE_LEAF] = node_pool_class(node_size(self, NODE_LEAF), node_align);
+		self->shared[NODE_INTERIOR] = node_pool_class(node_size(self, NODE_INTERIOR), node_align);
+		if(self->shared[NODE_LEAF] == NULL || self->shared[NODE_INTERIOR] == NULL) {
+			free_tree(self);
+			errno = ENOMEM;
+			return NULL;
+		}
+	}
+
+	return self;
+}
+
+void btree_memory_stats(
+		btree_t *self,
+		btree_memory_stats_t *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+	stats->tree = tree_size(self->element_size, self->element_align, self->small_max);
+	stats->overflow = tree_size(self->element_size, self->element_align, 0) - sizeof(btree_t) + sizeof(btree_link_t);
+	stats->payload = btree_memory_payload(self);
+	stats->leaf_nodes = self->nodes[NODE_LEAF];
+	stats->interior_nodes = self->nodes[NODE_INTERIOR];
+	stats->leaf_bytes = (uint64_t)self->nodes[NODE_LEAF] * node_size(self, NODE_LEAF);
+	stats->interior_bytes = (uint64_t)self->nodes[NODE_INTERIOR] * node_size(self, NODE_INTERIOR);
+	stats->pooled_nodes = self->pool_size[NODE_LEAF] + self->pool_size[NODE_INTERIOR];
+	stats->pooled_bytes = (uint64_t)self->pool_size[NODE_LEAF] * node_size(self, NODE_LEAF) + (uint64_t)self->pool_size[NODE_INTERIOR] * node_size(self, NODE_INTERIOR);
+	stats->static_bytes = self->layout.size;
+	stats->packed_bytes = self->packed.block_bytes;
+	stats->unpacked_bytes = (uint64_t)self->packed.n_open * unpacked_size(self);
+	stats->log_bytes = self->log.bytes;
+	stats->log_unused = self->log.bytes - self->log.slots * self->log.slot_size;
+	if((self->options & BTREE_OPT_ARENA) != 0) {
+		stats->arena_bytes = self->arena.bytes;
+		stats->arena_unused = self->arena.bytes - stats->leaf_bytes - stats->interior_bytes - stats->pooled_bytes;
+		stats->hugepage_bytes = self->arena.huge_bytes;
+		stats->total = stats->tree + self->arena.bytes + stats->static_bytes + stats->packed_bytes + stats->unpacked_bytes + stats->log_bytes;
+	}
+	else
+		stats->total = stats->tree + stats->leaf_bytes + stats->interior_bytes + stats->pooled_bytes + stats->static_bytes + stats->packed_bytes + stats->unpacked_bytes + stats->log_bytes;
+}
+
+uint64_t btree_memory_total(
+		btree_t *self)
+{
+	btree_memory_stats_t stats;
+
+	btree_memory_stats(self, &stats);
+	return stats.total;
+}
+
+uint64_t btree_memory_payload(
+		btree_t *self)
+{
+	if(self->root == NULL)
+		return 0;
+	else if((self->options & BTREE_OPT_VALUE_LOG) != 0)
+		return (uint64_t)self->log.value_size * subtree_size(self, self->root);
+	return (uint64_t)self->element_size * subtree_size(self, self->root);
+}
+
+uint64_t btree_memory_hugepage(
+		btree_t *self)
+{
+	return self->arena.huge_bytes;
+}
+
+void btree_set_data(
+		btree_t *self,
+		void *data)
+{
+	self->data = data;
+}
+
+void *btree_data(
+		btree_t *self)
+{
+	return self->data;
+}
 
-	if(node_candidate == NULL && prev != NULL) { /* all element keys less than requested key, select imaginary element after end (rightmost leaf node) */
-		node_candidate = prev;
-		pos_candidate = prev_u;
-	}
-	if(node != NULL)
-		*node = node_candidate;
-	if(pos != NULL)
-		*pos = pos_candidate;
-	return found;
+void btree_sethook_subelement(
+		btree_t *self,
+		int (*size)(btree_t *btree, const void *element),
+		void *(*sub)(btree_t *btree, void *element, int index))
+{
+	self->hook_size = size;
+	self->hook_sub = sub;
 }
 
+void btree_sethook_refcount(
+		btree_t *self,
+		int (*acquire)(btree_t *btree, void *element),
+		void (*release)(btree_t *btree, void *element))
+{
+	self->hook_release = release;
+	self->hook_acquire = acquire;
+}
 
-/* returns whether the given index has been found. if false:
- *   - 'node' == NULL: given index greater than size
- *   - 'node' != NULL: given index == size, can append at node->elements[pos] (note: 'pos' may be the overflow position) */
-static bool find_index(
-		btree_t *tree,
-		int index,
-		btree_node_t **node,
-		int *pos)
+void btree_set_group_default(
+		btree_t *self,
+		void *group)
 {
-	int u;
-	int l;
-	int m;
+	self->group_default = group;
+}
+
+void *btree_group_default(
+		btree_t *self)
+{
+	return self->group_default;
+}
+
+static void clear_nodes(
+		btree_t *tree)
+{
+	btree_node_t *prev;
 	btree_node_t *cur = tree->root;
-	int offset = 0;
-	int o;
-	int c;
+	int child_index = 0;
+	int i;
+	btree_index_t k;
+
+	if(isstatic(tree)) {
+		if(tree->hook_release != NULL)
+			for(k = 0; k < cur->fill; k++)
+				tree->hook_release(tree, GET_E(tree, node_element(tree, cur, k)));
+		tree->allocator.free(tree->layout.alloc, tree->layout.size, tree->allocator.context);
+		memset(&tree->layout, 0, sizeof(tree->layout));
+		tree->root = NULL;
+		return;
+	}
+
+#ifndef TESTING /* testing keeps track of every single node, see alloc_node() */
+	if((tree->options & BTREE_OPT_ARENA) != 0 && !packs_leaves(tree) && tree->hook_release == NULL) { /* nothing to do per element, drop all nodes at once */
+		tree->root = NULL;
+		memset(tree->pool, 0, sizeof(tree->pool));
+		memset(tree->pool_size, 0, sizeof(tree->pool_size));
+		memset(tree->nodes, 0, sizeof(tree->nodes));
+		if((tree->options & BTREE_OPT_KEEP_NODES) != 0 || tree->reserve[NODE_LEAF] > 0 || tree->reserve[NODE_INTERIOR] > 0)
+			arena_rewind(tree);
+		else
+			arena_release(tree);
+		return;
+	}
+#endif
 
 	while(cur != NULL) {
-		u = cur->fill;
-		l = 0;
-		while(l <= u) {
-			m = l + (u - l) / 2;
-			c = cur->links[m].count;
-			o = offset + cur->links[m].offset;
-			if(o + c == index) {
-				if(m == cur->fill && !isleaf(cur)) {
-					cur = cur->links[m].child;
-					offset = o;
-					break;
-				}
-				else {
-					if(node != NULL)
-						*node = cur;
-					if(pos != NULL)
-						*pos = m;
-					return m < cur->fill;
-				}
-			}
-			else if(o > index)
-				u = m - 1;
-			else if(o + c < index)
-				l = m + 1;
-			else {
-				cur = cur->links[m].child;
-				offset = o;
-				break;
+		while(!isleaf(cur) && child_index <= cur->fill) {
+			cur = cur->links[child_index].child;
+			child_index = 0;
+		}
+
+		if(tree->hook_release != NULL && cur->elements == NULL) { /* packed leaf: release decoded copies */
+			for(i = 0; i < cur->fill; i++) {
+				packed_get(tree, cur, i, tree->overflow_element);
+				tree->hook_release(tree, tree->overflow_element);
 			}
 		}
-		if(l > u)
-			break;
+		else if(tree->hook_release != NULL)
+			for(i = 0; i < cur->fill; i++)
+				tree->hook_release(tree, GET_E(tree, node_element(tree, cur, i)));
+		prev = cur;
+		child_index = cur->child_index;
+		cur = cur->parent;
+		if(cur != NULL)
+			cur->links[child_index].child = NULL;
+		child_index++;
+		free_node(tree, prev);
 	}
-	if(node != NULL)
-		*node = NULL;
-	if(pos != NULL)
-		*pos = 0;
-	return false;
+	tree->root = NULL;
 }
 
-static int to_index(
-		btree_node_t *node,
-		int pos)
+int btree_clear(
+		btree_t *self)
 {
-	int index;
+	if((self->options & OPT_FINALIZED) != 0)
+		return -EINVAL;
 
-	if(node == NULL)
-		return 0;
-	index = node->links[pos].count;
-	while(node != NULL) {
-		index += node->links[pos].offset;
-		pos = node->child_index;
-		node = node->parent;
-	}
-	return index;
+	clear_nodes(self);
+	log_release(self);
+	return 0;
 }
 
-static bool to_next(
-		btree_node_t **node_,
-		int *pos_)
+/* allocate nodes until the reservation is satisfied */
+static int fill_reserve(
+		btree_t *tree)
 {
-	btree_node_t *node = *node_;
-	int pos = *pos_;
-
-	if(pos == node->fill)
-		return false;
-	pos++;
-	/* descend */
-	while(node->links[pos].child != NULL) {
-		node = node->links[pos].child;
-		pos = 0;
-	}
-	/* ascend */
-	while(pos == node->fill) {
-		pos = node->child_index;
-		node = node->parent;
-		if(node == NULL) { /* end reached */
-			(*pos_)++; /* if we are here, *node_ is rightmost leaf. increase pos_ so that it points to imaginary element after end. */
-			return true;
+	btree_node_t *node;
+	int kind;
+
+	for(kind = NODE_LEAF; kind <= NODE_INTERIOR; kind++) {
+		while(tree->nodes[kind] + tree->pool_size[kind] < tree->reserve[kind]) {
+			node = node_memory(tree, kind);
+			if(node == NULL)
+				return -ENOMEM;
+			node->parent = tree->pool[kind];
+			tree->pool[kind] = node;
+			tree->pool_size[kind]++;
 		}
 	}
-	*node_ = node;
-	*pos_ = pos;
-	return true;
+	return 0;
 }
 
-static bool to_prev(
-		btree_node_t **node_,
-		int *pos_)
+int btree_reserve(
+		btree_t *self,
+		btree_index_t n_elements)
 {
-	btree_node_t *node = *node_;
-	int pos = *pos_;
+	btree_index_t n[2];
+	btree_index_t level;
+	int kind;
 
-	/* descend tree */
-	while(node->links[pos].child != NULL) {
-		node = node->links[pos].child;
-		pos = node->fill;
-	}
-	/* ascend tree */
-	while(pos == 0) {
-		pos = node->child_index;
-		node = node->parent;
-		if(node == NULL)
-			return false;
+	if(n_elements < 0)
+		return -EINVAL;
+
+	/* each node except root holds at least order / 2 elements, i.e. has at least order / 2 + 1 children;
+	 * one additional interior node is needed temporarily when the root node is split */
+	n[NODE_LEAF] = n_elements / (self->leaf_order / 2) + 1;
+	n[NODE_INTERIOR] = 1;
+	for(level = n[NODE_LEAF]; level > 1; ) {
+		level = (level + self->order / 2) / (self->order / 2 + 1);
+		n[NODE_INTERIOR] += level;
 	}
-	pos--;
-	*node_ = node;
-	*pos_ = pos;
-	return true;
+	for(kind = NODE_LEAF; kind <= NODE_INTERIOR; kind++)
+		if(n[kind] > self->reserve[kind])
+			self->reserve[kind] = n[kind];
+	return fill_reserve(self);
 }
 
-/* check, whether the specified element can be inserted/set at given index */
-static bool validate_at(
-		btree_t *tree,
-		const void *element,
-		btree_node_t *node,
-		int pos,
-		bool replace)
+void btree_shrink(
+		btree_t *self)
 {
-	btree_node_t *other_node;
-	int other_pos;
-	bool found;
+	int i;
 
-	/* TODO debug. if !node, a segfault happens (i.e. when validating against an empty tree). */
-	return true;
+	memset(self->reserve, 0, sizeof(self->reserve));
+	drain_pool(self);
+	log_trim(self);
+	for(i = self->packed.n_open - 1; i >= 0; i--) /* best effort, leaves which can't be packed remain unpacked */
+		leaf_close(self, self->packed.open[i]);
+}
 
+/* state of btree_compact(). level 0 contains the leaves */
+typedef struct {
+	btree_t *tree;
+	btree_t *old; /* describes the old nodes */
+	btree_node_t **nodes; /* all new nodes, level by level, each level in order */
+	int levels;
+	btree_index_t first[MAX_LEVELS]; /* index of first node of level within 'nodes' */
+	btree_index_t count[MAX_LEVELS]; /* number of nodes of level */
+	int base[MAX_LEVELS]; /* every node of level holds 'base' elements ... */
+	btree_index_t extra[MAX_LEVELS]; /* ... and the first 'extra' ones an additional one */
+	btree_index_t pos[MAX_LEVELS]; /* node of level currently filled */
+	int error; /* packed leaves: unpacking a new leaf failed */
+	size_t page_target; /* BTREE_OPT_VAR_ELEMENTS, BTREE_OPT_STRING_KEYS: bytes leaves are filled with ... */
+	int page_fill; /* ... and elements at most, see compact_page() */
+	size_t page_used; /* bytes of the leaf currently filled */
+	int page_count; /* elements of the leaf currently filled */
+	btree_index_t left; /* elements not passed to compact_page() yet */
+	const void *page_first; /* BTREE_OPT_STRING_KEYS: first element of the leaf currently filled */
+	size_t page_prefix; /* length of the prefix common to its keys */
+	size_t page_keys; /* bytes of its keys, see compact_page() */
+} compact_t;
+
+/* number of nodes needed to store 'n' elements (separators included) on a single level */
+static btree_index_t compact_nodes(
+		btree_index_t n,
+		int order,
+		double fill_factor)
+{
+	int min = order / 2;
+	int target = fill_factor * (order - 1);
+	btree_index_t nodes;
+
+	target = MAX(target, min);
+	target = MIN(target, order - 1);
+	nodes = (n + target + 1) / (target + 1); /* ceil((n + 1) / (target + 1)) */
+	nodes = MIN(nodes, (n + 1) / (min + 1)); /* don't underflow with few elements */
+	return MAX(nodes, 1);
+}
 
-	other_node = node;
-	other_pos = pos;
-	found = to_prev(&other_node, &other_pos);
-	if(found && tree->hook_cmp(tree, GET_E(tree, other_node->elements + other_pos * tree->element_size), element, tree->group_default) > 0) /* element before must be <= element to insert */
-		return false;
-	if(replace) {
-		other_node = node;
-		other_pos = pos;
-		found = to_next(&other_node, &other_pos);
-	}
-	else {
-		other_node = node;
-		other_pos = pos;
-		found = pos < node->fill;
+/* BTREE_OPT_VAR_ELEMENTS, BTREE_OPT_STRING_KEYS: whether the next element
+ * goes into the leaf currently filled. otherwise it separates that leaf from
+ * the next one, unless it is the last element, as every leaf needs one. the
+ * target leaves room for the largest element, so that it fits.
+ * BTREE_OPT_VAR_ELEMENTS: the element takes 'record' bytes.
+ * BTREE_OPT_STRING_KEYS: the bytes depend on the common prefix, which
+ * shrinks while the leaf is filled. keys are counted with the bytes they
+ * take with the longest prefix at most, which is an upper bound */
+static bool compact_page(
+		compact_t *c,
+		const void *element,
+		size_t record)
+{
+	btree_t *tree = c->tree;
+	size_t used = c->page_used + record;
+	size_t prefix = 0;
+	size_t keys = 0;
+	const uint8_t *bytes;
+
+	if((tree->options & BTREE_OPT_STRING_KEYS) != 0) {
+		keys = MIN(string_key(tree, element, &bytes), page_window(tree) + STRING_LEAF_PREFIX);
+		prefix = c->page_count == 0 ? MIN(keys, STRING_LEAF_PREFIX) : MIN(c->page_prefix, page_prefix(tree, c->page_first, element));
+		used = (c->page_count + 1) * sizeof(page_slot_t) + c->page_keys + keys - (c->page_count + 1) * prefix;
 	}
-	if(found && tree->hook_cmp(tree, GET_E(tree, other_node->elements + other_pos * tree->element_size), element, tree->group_default) < 0) /* element after must be >= element to insert */
+	c->left--;
+	if(c->page_count > 0 && c->left > 0 && (used > c->page_target || c->page_count >= c->page_fill)) {
+		c->page_used = 0;
+		c->page_count = 0;
+		c->page_keys = 0;
 		return false;
+	}
+	if(c->page_count == 0)
+		c->page_first = element;
+	c->page_prefix = prefix;
+	c->page_keys += keys;
+	c->page_used = used;
+	c->page_count++;
 	return true;
 }
 
-btree_t *btree_new(
-		int order,
-		int element_size,
-		int (*cmp)(btree_t *btree, const void *a, const void *b, void *group),
-		int options)
+/* BTREE_OPT_VAR_ELEMENTS, BTREE_OPT_STRING_KEYS: number of leaves
+ * compact_page() fills with the elements of an old subtree */
+static btree_index_t compact_pages(
+		compact_t *c,
+		btree_node_t *node)
 {
-	btree_t *self;
+	btree_index_t leaves = 0;
+	size_t record;
+	size_t len;
+	int i;
 
-	if(order < 3) {
-		errno = EINVAL;
-		return NULL;
-	}
-	else if(order % 2 == 0) { /* TODO there is a bug when removing an entry from an even-order btree. prevent using even order. */
-		errno = EINVAL;
-		return NULL;
-	}
-	else if((options & BTREE_OPT_RESERVED) != 0) {
-		errno = EINVAL;
-		return NULL;
+	for(i = 0; i <= node->fill; i++) {
+		if(!isleaf(node))
+			leaves += compact_pages(c, node->links[i].child);
+		if(i == node->fill)
+			break;
+		else if(node->elements == NULL) { /* packed leaf */
+			var_element(node_cache(c->old, node), i, &len);
+			record = sizeof(page_slot_t) + ALIGN_UP(len, c->tree->element_align);
+		}
+		else
+			record = page_record(c->tree, node_element(c->old, node, i), 0);
+		if(!compact_page(c, node->elements == NULL ? NULL : node_element(c->old, node, i), record))
+			leaves++;
 	}
+	return leaves;
+}
 
-	if(element_size < 0)
-		self = alloc_tree(sizeof(void*));
-	else
-		self = alloc_tree(element_size);
-	if(self == NULL) {
-		errno = ENOMEM;
-		return NULL;
+static void compact_emit(
+		compact_t *c,
+		int level,
+		const void *element)
+{
+	btree_t *tree = c->tree;
+	btree_node_t *node = c->nodes[c->first[level] + c->pos[level]];
+	btree_node_t *parent;
+
+	if(c->error != 0)
+		return;
+	else if(level == 0 && paged(tree, node) ? compact_page(c, element, page_record(tree, element, 0)) : node->fill < c->base[level] + (c->pos[level] < c->extra[level] ? 1 : 0)) {
+		c->error = leaf_open(tree, node);
+		if(c->error != 0)
+			return;
+		memcpy(node_element(tree, node, node->fill), element, tree->element_size);
+		node->fill++;
+		if(packs_leaves(tree) && level == 0) /* the leaf may be packed before it is complete */
+			((packed_leaf_t*)node_cache(tree, node))->dirty = true;
+		return;
 	}
 
-	self->options = options;
-	self->order = order;
-	self->hook_cmp = cmp;
-	if(element_size < 0) {
-		self->element_size = sizeof(void*);
-		self->options |= OPT_USE_POINTERS;
+	/* node is complete, the element separates it from its right sibling */
+	assert(level + 1 < c->levels);
+	compact_emit(c, level + 1, element);
+	c->pos[level]++;
+	assert(c->pos[level] < c->count[level]);
+	node = c->nodes[c->first[level] + c->pos[level]];
+	parent = c->nodes[c->first[level + 1] + c->pos[level + 1]];
+	node->parent = parent;
+	node->child_index = parent->fill;
+	parent->links[parent->fill].child = node;
+}
+
+/* feed all elements of an old subtree in order */
+static void compact_copy(
+		compact_t *c,
+		btree_node_t *node)
+{
+	int i;
+
+	for(i = 0; i <= node->fill; i++) {
+		if(!isleaf(node))
+			compact_copy(c, node->links[i].child);
+		if(i < node->fill && node->elements == NULL) { /* packed leaf: decode into the unused overflow slot */
+			packed_get(c->tree, node, i, c->tree->overflow_element);
+			compact_emit(c, 0, c->tree->overflow_element);
+		}
+		else if(i < node->fill)
+			compact_emit(c, 0, node_element(c->old, node, i));
 	}
-	else
-		self->element_size = element_size;
-	if(cmp == NULL)
-		self->options |= OPT_NOCMP;
+}
 
-	return self;
+static void free_subtree(
+		btree_t *tree,
+		btree_node_t *node)
+{
+	int i;
+
+	if(!isleaf(node))
+		for(i = 0; i <= node->fill; i++)
+			free_subtree(tree, node->links[i].child);
+	free_node(tree, node);
 }
 
-uint64_t btree_memory_total(
-		btree_t *self)
+int btree_compact(
+		btree_t *self,
+		double fill_factor,
+		int new_order)
 {
-	uint64_t bytes = sizeof(btree_t) + self->element_size; /* see alloc_tree() */
-	btree_node_t *cur;
-	int n_nodes = 0;
-	int pow = 0;
-	for(cur = self->root; cur != NULL; cur = cur->links[0].child) {
-		if(pow == 0)
-			pow = 1;
-		else
-			pow *= self->order;
-		n_nodes += pow;
+	btree_t old;
+	compact_t c;
+	btree_node_t *node;
+	btree_index_t n = btree_size(self);
+	btree_index_t total;
+	int level;
+	btree_index_t i;
+	int l;
+	btree_index_t offset;
+	int ret;
+
+	if((self->options & OPT_FINALIZED) != 0)
+		return -EINVAL;
+	else if(!(fill_factor > 0 && fill_factor <= 1))
+		return -EINVAL;
+	else if(new_order != 0 && (new_order < 3 || new_order % 2 == 0))
+		return -EINVAL;
+	else if(new_order - 1 > UINT16_MAX && (self->options & BTREE_OPT_DUP_RUNS) != 0) /* see btree_new_ex() */
+		return -EINVAL;
+	else if(new_order - 1 > UINT8_MAX + 1 && (self->options & BTREE_OPT_PERMUTED_LEAVES) != 0)
+		return -EINVAL;
+	assert(self->overflow_node == NULL);
+	if(self->root == &self->small && (ret = small_promote(self)) != 0) /* rebuilt like any other root leaf, the capacity may change with the order */
+		return ret;
+
+	/* the old nodes are described by a copy of the tree, the tree itself receives the new ones */
+	old = *self;
+	self->root = NULL;
+	memset(self->pool, 0, sizeof(self->pool));
+	memset(self->pool_size, 0, sizeof(self->pool_size));
+	memset(self->nodes, 0, sizeof(self->nodes));
+	memset(&self->packed, 0, sizeof(self->packed));
+	memset(&self->arena, 0, sizeof(self->arena));
+	self->arena.chunk_size = old.arena.chunk_size;
+	if(new_order != 0) {
+		self->order = new_order;
+		self->leaf_order = new_order;
+		setup_layout(self);
+		choose_search(self);
+		if(self->shared[NODE_LEAF] != NULL) {
+			self->shared[NODE_LEAF] = node_pool_class(node_size(self, NODE_LEAF), self->node_align);
+			self->shared[NODE_INTERIOR] = node_pool_class(node_size(self, NODE_INTERIOR), self->node_align);
+			if(self->shared[NODE_LEAF] == NULL || self->shared[NODE_INTERIOR] == NULL) {
+				*self = old;
+				return -ENOMEM;
+			}
+		}
+	}
+	if(n == 0) {
+		drain_pool(&old);
+		fill_reserve(self); /* best effort, the tree is usable anyway */
+		return 0;
+	}
+
+	/* number of nodes per level; 'n' is the number of elements on a level,
+	 * all but one per node are passed to the level above as separators */
+	memset(&c, 0, sizeof(c));
+	c.tree = self;
+	c.old = &old;
+	if((self->options & (BTREE_OPT_VAR_ELEMENTS | BTREE_OPT_STRING_KEYS)) != 0) { /* leaves are filled by bytes, count them ahead */
+		c.page_target = MIN((size_t)(fill_factor * self->leaf_bytes), self->leaf_bytes - page_record_max(self));
+		c.page_fill = MAX(1, MIN((int)(fill_factor * (self->leaf_order - 1)), self->leaf_order - 2));
+		c.left = n;
+		c.count[0] = compact_pages(&c, old.root) + 1;
+		c.left = n;
+		c.page_used = 0;
+		c.page_count = 0;
+		c.page_keys = 0;
 	}
-	bytes += n_nodes * (sizeof(btree_node_t) + sizeof(btree_link_t) * self->order + self->element_size * (self->order - 1)); /* see alloc_node() */
-	return bytes;
-}
+	total = 0;
+	for(level = 0; level == 0 || c.count[level - 1] > 1; level++) {
+		assert(level < MAX_LEVELS);
+		c.first[level] = total;
+		if(level > 0 || (self->options & (BTREE_OPT_VAR_ELEMENTS | BTREE_OPT_STRING_KEYS)) == 0)
+			c.count[level] = compact_nodes(n, level == 0 ? self->leaf_order : self->order, fill_factor);
+		c.base[level] = (n - (c.count[level] - 1)) / c.count[level];
+		c.extra[level] = (n - (c.count[level] - 1)) % c.count[level];
+		assert(c.base[level] + (c.extra[level] > 0 ? 1 : 0) <= (level == 0 ? self->leaf_order : self->order) - 1);
+		total += c.count[level];
+		n = c.count[level] - 1;
+	}
+	c.levels = level;
 
-uint64_t btree_memory_payload(
-		btree_t *self)
-{
-	if(self->root == NULL)
-		return 0;
-	return self->element_size * (self->root->links[self->root->fill].offset + self->root->links[self->root->fill].count);
-}
+	/* allocate level by level, so that leaves end up next to each other */
+	c.nodes = self->allocator.alloc(total * sizeof(btree_node_t*), NODE_ALIGN, self->allocator.context);
+	if(c.nodes == NULL) {
+		*self = old;
+		return -ENOMEM;
+	}
+	for(i = 0; i < total; i++) {
+		c.nodes[i] = alloc_node(self, i < c.first[1] || c.levels == 1 ? NODE_LEAF : NODE_INTERIOR);
+		if(c.nodes[i] == NULL) {
+			while(i-- > 0)
+				free_node(self, c.nodes[i]);
+			drain_pool(self);
+			self->allocator.free(c.nodes, total * sizeof(btree_node_t*), self->allocator.context);
+			*self = old;
+			return -ENOMEM;
+		}
+	}
 
-void btree_set_data(
-		btree_t *self,
-		void *data)
-{
-	self->data = data;
-}
+	/* the first node of every level is the leftmost child of the level above */
+	for(level = 0; level + 1 < c.levels; level++) {
+		node = c.nodes[c.first[level]];
+		node->parent = c.nodes[c.first[level + 1]];
+		node->parent->links[0].child = node;
+	}
+	compact_copy(&c, old.root);
+	if(c.error != 0) {
+		for(i = 0; i < total; i++)
+			free_node(self, c.nodes[i]);
+		drain_pool(self);
+		self->allocator.free(c.nodes, total * sizeof(btree_node_t*), self->allocator.context);
+		*self = old;
+		return c.error;
+	}
 
-void *btree_data(
-		btree_t *self)
-{
-	return self->data;
+	/* subtree counts are known once the levels below are complete */
+	for(level = 1; level < c.levels; level++) {
+		for(i = 0; i < c.count[level]; i++) {
+			node = c.nodes[c.first[level] + i];
+			offset = 0;
+			for(l = 0; l <= node->fill; l++) {
+				node->links[l].offset = offset;
+				node->links[l].count = subtree_size(self, node->links[l].child);
+				offset += node->links[l].count + 1;
+			}
+		}
+	}
+	for(i = 0; i < total; i++)
+		node_changed(self, c.nodes[i]);
+	self->root = c.nodes[total - 1];
+	self->allocator.free(c.nodes, total * sizeof(btree_node_t*), self->allocator.context);
+
+	free_subtree(&old, old.root);
+	drain_pool(&old);
+	small_demote(self, small_capacity(self));
+	fill_reserve(self); /* best effort, see above */
+	return 0;
 }
 
-void btree_sethook_subelement(
-		btree_t *self,
-		int (*size)(btree_t *btree, const void *element),
-		void *(*sub)(btree_t *btree, void *element, int index))
+/* copy all elements of a subtree in order, returns end of copied elements */
+static void *static_copy(
+		btree_t *tree,
+		btree_node_t *node,
+		void *dst)
 {
-	self->hook_size = size;
-	self->hook_sub = sub;
-}
+	int i;
 
-void btree_sethook_refcount(
-		btree_t *self,
-		int (*acquire)(btree_t *btree, void *element),
-		void (*release)(btree_t *btree, void *element))
-{
-	self->hook_release = release;
-	self->hook_acquire = acquire;
+	if(isleaf(node) && node->elements == NULL) /* packed leaf */
+		for(i = 0; i < node->fill; i++)
+			packed_get(tree, node, i, dst + i * tree->element_size);
+	else if(permutes(tree, node))
+		for(i = 0; i < node->fill; i++)
+			memcpy(dst + i * tree->element_size, node_element(tree, node, i), tree->element_size);
+	else if(isleaf(node))
+		memcpy(dst, node->elements, node->fill * tree->element_size);
+	if(isleaf(node))
+		return dst + node->fill * tree->element_size;
+	for(i = 0; i <= node->fill; i++) {
+		dst = static_copy(tree, node->links[i].child, dst);
+		if(i < node->fill) {
+			memcpy(dst, node->elements + i * tree->element_size, tree->element_size);
+			dst += tree->element_size;
+		}
+	}
+	return dst;
 }
 
-void btree_set_group_default(
-		btree_t *self,
-		void *group)
+/* place samples into the Eytzinger array by an in-order walk of the implicit tree.
+ * 'rank' is the next sample to place, returns the one after the last placed */
+static btree_index_t static_index(
+		btree_t *tree,
+		btree_index_t k,
+		btree_index_t rank)
 {
-	self->group_default = group;
+	if(k > tree->layout.n_samples)
+		return rank;
+	rank = static_index(tree, 2 * k, rank);
+	memcpy(tree->layout.samples + (size_t)k * tree->element_size, tree->layout.root.elements + (size_t)(rank * tree->layout.block) * tree->element_size, tree->element_size);
+	tree->layout.ranks[k] = rank * tree->layout.block;
+	return static_index(tree, 2 * k + 1, rank + 1);
 }
 
-void *btree_group_default(
-		btree_t *self)
+int btree_finalize_ex(
+		btree_t *self,
+		int layout)
 {
-	return self->group_default;
-}
+	btree_index_t n = btree_size(self);
+	size_t samples_offset;
+	size_t ranks_offset;
 
-int btree_clear(
-		btree_t *self)
-{
-	btree_node_t *prev;
-	btree_node_t *cur = self->root;
-	int child_index = 0;
-	int i;
+	if(layout == BTREE_LAYOUT_NODES && packs_leaves(self) && n > 0 && !isstatic(self)) /* leaves are only unpacked for a while (see leaf_open()), pointers to elements wouldn't stay valid */
+		layout = BTREE_LAYOUT_SORTED;
 
-	if((self->options & OPT_FINALIZED) != 0)
+	if(layout != BTREE_LAYOUT_NODES && layout != BTREE_LAYOUT_SORTED && layout != BTREE_LAYOUT_EYTZINGER)
 		return -EINVAL;
+	else if(isstatic(self))
+		return -EINVAL;
+	else if(layout == BTREE_LAYOUT_NODES || n == 0) {
+		self->options |= OPT_FINALIZED;
+		return 0;
+	}
 
-	while(cur != NULL) {
-		while(child_index <= cur->fill && cur->links[child_index].child != NULL) {
-			cur = cur->links[child_index].child;
-			child_index = 0;
-		}
-
-		if(self->hook_release != NULL)
-			for(i = 0; i < cur->fill; i++)
-				self->hook_release(self, GET_E(self, cur->elements + i * self->element_size));
-		prev = cur;
-		child_index = cur->child_index;
-		cur = cur->parent;
-		if(cur != NULL)
-			cur->links[child_index].child = NULL;
-		child_index++;
-		free_node(prev);
+	self->layout.block = MAX(2, STATIC_BLOCK_BYTES / self->element_size);
+	if(layout == BTREE_LAYOUT_EYTZINGER && (self->options & OPT_NOCMP) == 0)
+		self->layout.n_samples = (n + self->layout.block - 1) / self->layout.block;
+	samples_offset = ALIGN_UP((size_t)n * self->element_size, self->element_align);
+	ranks_offset = ALIGN_UP(samples_offset + (size_t)(self->layout.n_samples + 1) * self->element_size, sizeof(btree_index_t));
+	self->layout.size = ranks_offset + (size_t)(self->layout.n_samples + 1) * sizeof(btree_index_t);
+	self->layout.alloc = self->allocator.alloc(self->layout.size, MAX(NODE_ALIGN, self->element_align), self->allocator.context);
+	if(self->layout.alloc == NULL) {
+		memset(&self->layout, 0, sizeof(self->layout));
+		return -ENOMEM;
 	}
-	self->root = NULL;
+	self->layout.samples = self->layout.alloc + samples_offset;
+	self->layout.ranks = self->layout.alloc + ranks_offset;
+
+	/* the static root is a leaf containing every element; iterators and index
+	 * based access work on it like on any other leaf */
+	self->layout.root.fill = n;
+	self->layout.root.elements = self->layout.alloc;
+	static_copy(self, self->root, self->layout.alloc);
+	static_index(self, 1, 0);
+
+	free_subtree(self, self->root);
+	self->root = &self->layout.root;
+	memset(self->reserve, 0, sizeof(self->reserve));
+	drain_pool(self);
+	self->options |= OPT_FINALIZED;
 	return 0;
 }
 
 void btree_finalize(
 		btree_t *self)
 {
-	self->options |= OPT_FINALIZED;
+	btree_finalize_ex(self, BTREE_LAYOUT_NODES);
 }
 
 int btree_is_finalized(
@@ -1299,52 +4680,73 @@ int btree_is_finalized(
 void btree_destroy(
 		btree_t *self)
 {
-	btree_clear(self);
-	free(self);
+	clear_nodes(self);
+	log_release(self);
+	drain_pool(self);
+	free_tree(self);
 }
 
-int btree_size(
+btree_index_t btree_size(
 		btree_t *self)
 {
 /*	int n = 0;
 	int i;*/
 	if(self->root == NULL)
 		return 0;
-	return self->root->links[self->root->fill].offset + self->root->links[self->root->fill].count;
+	return subtree_size(self, self->root);
 /*	for(i = 0; i <= self->root->fill; i++)
 		n += self->root->links[i].count;
 	n += self->root->fill;
 	return n;*/
 }
 
-int btree_size_group(
+btree_index_t btree_size_group(
 		btree_t *self,
 		const void *key,
 		void *group)
 {
-	btree_node_t *node;
-	int pos;
-	int l;
-	int u;
+	btree_node_t *node = self->root;
+	search_key_t lower;
+	search_key_t upper;
+	btree_index_t l;
+	btree_index_t u;
+
 	if(self->root == NULL)
 		return 0;
+	else if(isstatic(self)) {
+		static_find(self, key, NULL, &l, group, self->hook_cmp, false);
+		static_find(self, key, NULL, &u, group, self->hook_cmp, true);
+		return u - l;
+	}
 
-	find_lower(self, key, &node, &pos, group, self->hook_cmp);
-	l = to_index(node, pos);
-	find_upper(self, key, &node, &pos, group, self->hook_cmp);
-	u = to_index(node, pos);
-	return u - l;
+	/* both bounds share their path from the root until the group is found,
+	 * from there on, the lower bound follows the left and the upper bound the right edge of the group */
+	search_key_init(self, key, self->hook_cmp, &lower);
+	while(node != NULL) {
+		search_key_node(self, node, &lower);
+		l = node_bound(self, node, 0, node->fill, key, group, self->hook_cmp, &lower, false, NULL);
+		u = node_bound(self, node, l, node->fill, key, group, self->hook_cmp, &lower, true, NULL);
+		if(l != u) {
+			upper = lower;
+			return link_offset(node, u) - link_offset(node, l) +
+				subtree_rank(self, link_child(node, u), key, group, self->hook_cmp, &upper, true) -
+				subtree_rank(self, link_child(node, l), key, group, self->hook_cmp, &lower, false);
+		}
+		node = link_child(node, l);
+	}
+	return 0;
 }
 
 int btree_swap(
 		btree_t *self,
-		int index_a,
-		int index_b)
+		btree_index_t index_a,
+		btree_index_t index_b)
 {
 	btree_node_t *node_a;
 	btree_node_t *node_b;
-	int pos_a;
-	int pos_b;
+	btree_index_t pos_a;
+	btree_index_t pos_b;
+	int ret;
 
 	if((self->options & OPT_FINALIZED) != 0)
 		return -EINVAL;
@@ -1359,20 +4761,28 @@ int btree_swap(
 
 	find_index(self, index_a, &node_a, &pos_a);
 	find_index(self, index_b, &node_b, &pos_b);
-	if((self->options & OPT_NOCMP) == 0 && self->hook_cmp(self, GET_E(self, node_a->elements + pos_a * self->element_size), GET_E(self, node_b->elements + pos_b * self->element_size), self->group_default) != 0)
+	if((ret = leaf_open(self, node_a)) != 0 || (ret = leaf_open(self, node_b)) != 0)
+		return ret;
+	if((self->options & OPT_NOCMP) == 0 && self->hook_cmp(self, GET_E(self, node_element(self, node_a, pos_a)), element_key(self, GET_E(self, node_element(self, node_b, pos_b))), self->group_default) != 0)
 		return -EINVAL;
-	memcpy(self->overflow_element, node_a->elements + pos_a * self->element_size, self->element_size);
-	memcpy(node_a->elements + pos_a * self->element_size, node_b->elements + pos_b * self->element_size, self->element_size);
-	memcpy(node_b->elements + pos_b * self->element_size, self->overflow_element, self->element_size);
+	memcpy(self->overflow_element, node_element(self, node_a, pos_a), self->element_size);
+	memcpy(node_element(self, node_a, pos_a), node_element(self, node_b, pos_b), self->element_size);
+	memcpy(node_element(self, node_b, pos_b), self->overflow_element, self->element_size);
 	memset(self->overflow_element, 0, self->element_size);
-	return 0;
+	node_changed(self, node_a);
+	node_changed(self, node_b);
+	if(paged(self, node_a) && page_overflowing(self, node_a) && (ret = page_adjust(self, node_a)) != 0) /* only splits, 'node_b' remains */
+		return ret;
+	if(paged(self, node_b) && (ret = leaf_open(self, node_b)) == 0 && page_overflowing(self, node_b))
+		ret = page_adjust(self, node_b);
+	return ret;
 }
 
 int btree_insert(
 		btree_t *self,
 		void *element)
 {
-	int pos;
+	btree_index_t pos;
 	btree_node_t *cur;
 	bool found;
 
@@ -1384,9 +4794,9 @@ int btree_insert(
 		return -EINVAL;
 
 	if((self->options & BTREE_OPT_INSERT_LOWER) != 0)
-		found = find_lower(self, element, &cur, &pos, self->group_default, self->hook_cmp);
+		found = find_lower(self, element_key(self, element), &cur, &pos, self->group_default, self->hook_cmp);
 	else
-		found = find_upper(self, element, &cur, &pos, self->group_default, self->hook_cmp);
+		found = find_upper(self, element_key(self, element), &cur, &pos, self->group_default, self->hook_cmp);
 	to_insert_before(self, &cur, &pos);
 	if((self->options & BTREE_OPT_MULTI_KEY) != 0 || !found)
 		return node_insert(self, cur, pos, element);
@@ -1396,10 +4806,10 @@ int btree_insert(
 
 int btree_insert_at(
 		btree_t *self,
-		int index,
+		btree_index_t index,
 		void *element)
 {
-	int pos;
+	btree_index_t pos;
 	btree_node_t *cur;
 
 	assert(self->overflow_node == NULL);
@@ -1422,7 +4832,7 @@ int btree_put(
 		btree_t *self,
 		void *element)
 {
-	int pos;
+	btree_index_t pos;
 	btree_node_t *cur;
 	bool found;
 
@@ -1433,7 +4843,7 @@ int btree_put(
 	else if((self->options & OPT_NOCMP) != 0) /* insert by key only if cmp is used */
 		return -EINVAL;
 
-	found = find_lower(self, element, &cur, &pos, self->group_default, self->hook_cmp);
+	found = find_lower(self, element_key(self, element), &cur, &pos, self->group_default, self->hook_cmp);
 	if(found)
 		return node_replace(self, cur, pos, element);
 	else {
@@ -1444,10 +4854,10 @@ int btree_put(
 
 int btree_put_at(
 		btree_t *self,
-		int index,
+		btree_index_t index,
 		void *element)
 {
-	int pos;
+	btree_index_t pos;
 	btree_node_t *cur;
 	bool found;
 
@@ -1478,7 +4888,7 @@ int btree_put_at(
 		btree_t *self,
 		const void *key)
 {
-	int pos;
+	btree_index_t pos;
 	btree_node_t *cur;
 
 	assert(self->overflow_node == NULL);
@@ -1506,38 +4916,225 @@ void *btree_get(
 		btree_t *self,
 		const void *key)
 {
-	int pos;
+	btree_index_t pos;
 	btree_node_t *node;
-	if(find_lower(self, key, &node, &pos, self->group_default, self->hook_cmp))
-		return GET_E(self, node->elements + pos * self->element_size);
-	else
+	int ret;
+
+	if(!find_lower(self, key, &node, &pos, self->group_default, self->hook_cmp))
+		return NULL;
+	else if((ret = leaf_open(self, node)) != 0) {
+		errno = -ret;
 		return NULL;
+	}
+	else
+		return GET_E(self, node_element(self, node, pos));
 }
 
 void *btree_get_at(
 		btree_t *self,
-		int index)
+		btree_index_t index)
 {
 	btree_node_t *node;
-	int pos;
+	btree_index_t pos;
+	int ret;
 
 	if(index < 0) {
 		errno = -EOVERFLOW;
 		return NULL;
 	}
-	if(find_index(self, index, &node, &pos))
-		return GET_E(self, node->elements + pos * self->element_size);
+	if(find_index(self, index, &node, &pos)) {
+		if((ret = leaf_open(self, node)) != 0) {
+			errno = -ret;
+			return NULL;
+		}
+		return GET_E(self, node_element(self, node, pos));
+	}
 	else {
 		errno = -EOVERFLOW;
 		return NULL;
 	}
 }
 
+/* the results of a batch; returns the number of lookups found */
+static int batch_results(
+		btree_t *tree,
+		const lookup_t *lookups,
+		int n,
+		void **elements,
+		btree_index_t *indices)
+{
+	int found = 0;
+	int i;
+
+	for(i = 0; i < n; i++) {
+		if(elements != NULL)
+			elements[i] = lookups[i].found ? GET_E(tree, node_element(tree, lookups[i].node, lookups[i].pos)) : NULL;
+		if(indices != NULL)
+			indices[i] = lookups[i].found ? to_index(lookups[i].node, lookups[i].pos) : -ENOENT;
+		found += lookups[i].found;
+	}
+	return found;
+}
+
+btree_index_t btree_get_many(
+		btree_t *self,
+		const void *const *keys,
+		btree_index_t n,
+		void **elements,
+		btree_index_t *indices)
+{
+	lookup_t lookups[BATCH_LOOKUPS];
+	lookup_t *lookup;
+	int batch;
+	btree_index_t found = 0;
+	btree_index_t first;
+	int active;
+	int i;
+	int l;
+	bool eq;
+
+	if(self->options & OPT_NOCMP)
+		return -EINVAL;
+	else if(n < 0)
+		return -EINVAL;
+	else if(elements != NULL && packs_leaves(self)) /* only a few leaves are kept unpacked at once */
+		return -ENOTSUP;
+
+	for(first = 0; first < n; first += batch) {
+		batch = MIN(n - first, BATCH_LOOKUPS);
+		for(i = 0; i < batch; i++) {
+			lookup = lookups + i;
+			lookup->node = NULL;
+			lookup->found = false;
+			if(isstatic(self)) {
+				lookup->cur = NULL;
+				lookup->found = static_find(self, keys[first + i], &lookup->node, &lookup->pos, self->group_default, self->hook_cmp, false);
+			}
+			else {
+				lookup->cur = self->root;
+				search_key_init(self, keys[first + i], self->hook_cmp, &lookup->q);
+			}
+		}
+		/* as in find_lower(). all leaves are at the same depth, so the descents
+		 * proceed level by level: all of them search their nodes and fetch the
+		 * links to follow, then all of them follow those and fetch the next
+		 * nodes, so that the misses of the descents overlap */
+		do {
+			active = 0;
+			for(i = 0; i < batch; i++) {
+				lookup = lookups + i;
+				if(lookup->cur == NULL)
+					continue;
+				search_key_node(self, lookup->cur, &lookup->q);
+				l = node_bound(self, lookup->cur, 0, lookup->cur->fill, keys[first + i], self->group_default, self->hook_cmp, &lookup->q, false, &eq);
+				if(l < lookup->cur->fill) {
+					lookup->node = lookup->cur;
+					lookup->pos = l;
+					lookup->found = lookup->found || eq;
+				}
+				if(isleaf(lookup->cur))
+					lookup->cur = NULL;
+				else {
+					lookup->link = l;
+					__builtin_prefetch(&lookup->cur->links[l]);
+					active++;
+				}
+			}
+			for(i = 0; i < batch; i++) {
+				lookup = lookups + i;
+				if(lookup->cur != NULL) {
+					lookup->cur = lookup->cur->links[lookup->link].child;
+					fetch_node(self, lookup->cur);
+				}
+			}
+		} while(active > 0);
+		found += batch_results(self, lookups, batch, elements == NULL ? NULL : elements + first, indices == NULL ? NULL : indices + first);
+	}
+	return found;
+}
+
+btree_index_t btree_get_at_many(
+		btree_t *self,
+		const btree_index_t *indices,
+		btree_index_t n,
+		void **elements)
+{
+	lookup_t lookups[BATCH_LOOKUPS];
+	lookup_t *lookup;
+	btree_node_t *leaf = NULL; /* leaf of the last index found within a leaf ... */
+	btree_index_t base = 0; /* ... and the index of its first element */
+	btree_index_t index;
+	int batch;
+	btree_index_t found = 0;
+	btree_index_t first;
+	int active;
+	int i;
+	btree_index_t m;
+
+	if(n < 0)
+		return -EINVAL;
+	else if(elements != NULL && packs_leaves(self)) /* only a few leaves are kept unpacked at once */
+		return -ENOTSUP;
+
+	for(first = 0; first < n; first += batch) {
+		batch = MIN(n - first, BATCH_LOOKUPS);
+		for(i = 0; i < batch; i++) {
+			lookup = lookups + i;
+			index = indices[first + i];
+			lookup->found = false;
+			lookup->offset = 0;
+			if(leaf != NULL && index >= base && index - base < leaf->fill) { /* sorted indices are mostly next to the previous one */
+				lookup->cur = NULL;
+				lookup->node = leaf;
+				lookup->pos = index - base;
+				lookup->found = true;
+			}
+			else
+				lookup->cur = index < 0 ? NULL : self->root;
+		}
+		/* as in find_index(), advanced level by level as in btree_get_many() */
+		do {
+			active = 0;
+			for(i = 0; i < batch; i++) {
+				lookup = lookups + i;
+				if(lookup->cur == NULL)
+					continue;
+				index = indices[first + i] - lookup->offset;
+				if(isleaf(lookup->cur))
+					m = index < lookup->cur->fill ? index : lookup->cur->fill + 1;
+				else
+					m = link_bound(self, lookup->cur, index);
+				if(m > lookup->cur->fill)
+					lookup->cur = NULL;
+				else if(link_offset(lookup->cur, m) + link_count(lookup->cur, m) == index && m < lookup->cur->fill) {
+					lookup->node = lookup->cur;
+					lookup->pos = m;
+					lookup->found = true;
+					lookup->cur = NULL;
+				}
+				else {
+					lookup->offset += link_offset(lookup->cur, m);
+					lookup->cur = lookup->cur->links[m].child;
+					fetch_node(self, lookup->cur);
+					active++;
+				}
+			}
+		} while(active > 0);
+		for(i = 0; i < batch; i++)
+			if(lookups[i].found && isleaf(lookups[i].node)) {
+				leaf = lookups[i].node;
+				base = indices[first + i] - lookups[i].pos;
+			}
+		found += batch_results(self, lookups, batch, elements == NULL ? NULL : elements + first, NULL);
+	}
+	return found;
+}
+
 int btree_remove(
 		btree_t *self,
 		void *element)
 {
-	int pos;
+	btree_index_t pos;
 	btree_node_t *cur;
 
 	assert(self->overflow_node == NULL);
@@ -1547,7 +5144,7 @@ int btree_remove(
 	else if(self->options & OPT_NOCMP) /* remove by key only if cmp is present */
 		return -EINVAL;
 
-	if(!find_lower(self, element, &cur, &pos, self->group_default, self->hook_cmp))
+	if(!find_lower(self, element_key(self, element), &cur, &pos, self->group_default, self->hook_cmp))
 		return -ENOENT;
 	else
 		return node_remove(self, cur, pos);
@@ -1555,10 +5152,10 @@ int btree_remove(
 
 int btree_remove_at(
 		btree_t *self,
-		int index)
+		btree_index_t index)
 {
 	btree_node_t *node;
-	int pos;
+	btree_index_t pos;
 
 	assert(self->overflow_node == NULL);
 
@@ -1575,8 +5172,8 @@ int btree_remove_group(
 		const void *key,
 		void *group)
 {
-	int l = btree_find_lower_group(self, key, group, NULL);
-	int u = btree_find_upper_group(self, key, group, NULL);
+	btree_index_t l = btree_find_lower_group(self, key, group, NULL);
+	btree_index_t u = btree_find_upper_group(self, key, group, NULL);
 	if(l < 0)
 		return l;
 	else if(u < 0)
@@ -1587,8 +5184,8 @@ int btree_remove_group(
 
 int btree_remove_range(
 		btree_t *self,
-		int l,
-		int u)
+		btree_index_t l,
+		btree_index_t u)
 {
 	int ret;
 	while(u-- > l)
@@ -1597,45 +5194,51 @@ int btree_remove_range(
 	return 0;
 }
 
-int btree_find(
+btree_index_t btree_find(
 		btree_t *self,
 		const void *key,
 		btree_it_t *it)
 {
 	btree_node_t *node;
-	int pos;
-	int index;
+	btree_index_t pos;
+	btree_index_t index;
+	int ret;
 
 	if(self->options & OPT_NOCMP)
 		return -EINVAL;
 
 	if(!find_lower(self, key, &node, &pos, self->group_default, self->hook_cmp))
 		return -ENOENT;
+	else if(it != NULL && (ret = leaf_open(self, node)) != 0)
+		return ret;
 	index = to_index(node, pos);
 	if(it != NULL) {
 		memset(it, 0, sizeof(*it));
 		it->tree = self;
 		it->pos = pos;
 		it->node = node;
-		it->element = GET_E(self, node->elements + pos * self->element_size);
+		it->element = GET_E(self, node_element(self, node, pos));
 		it->index = index;
 		it->found = true;
 	}
 	return index;
 }
 
-int btree_find_at(
+btree_index_t btree_find_at(
 		btree_t *self,
-		int index,
+		btree_index_t index,
 		btree_it_t *it)
 {
 	btree_node_t *node;
-	int pos;
+	btree_index_t pos;
+	int ret;
 
 	if(find_index(self, index, &node, &pos)) {
+		if(it != NULL && (ret = leaf_open(self, node)) != 0)
+			return ret;
 		if(it != NULL) {
 			memset(it, 0, sizeof(*it));
-			it->element = GET_E(self, node->elements + pos * self->element_size);
+			it->element = GET_E(self, node_element(self, node, pos));
 			it->index = index;
 			it->tree = self;
 			it->node = node;
@@ -1653,23 +5256,27 @@ int btree_find_at(
 	}
 }
 
-int btree_find_begin(
+btree_index_t btree_find_begin(
 		btree_t *self,
 		btree_it_t *it)
 {
 	btree_node_t *child = self->root;
 	btree_node_t *node = child;
+	int ret;
 
 	if(it != NULL) {
 		while(child != NULL) {
 			node = child;
-			child = node->links[0].child;
+			child = link_child(node, 0);
 		}
+		ret = leaf_open(self, node);
+		if(ret != 0)
+			return ret;
 		memset(it, 0, sizeof(*it));
 		if(node == NULL)
 			it->element = NULL;
 		else
-			it->element = GET_E(self, node->elements);
+			it->element = GET_E(self, node_element(self, node, 0));
 		it->index = 0;
 		it->tree = self;
 		it->node = node;
@@ -1679,13 +5286,12 @@ int btree_find_begin(
 	return 0;
 }
 
-int btree_find_end(
+btree_index_t btree_find_end(
 		btree_t *self,
 		btree_it_t *it)
 {
 	btree_node_t *node = self->root;
-	int index = 0;
-	int i;
+	btree_index_t index = 0;
 
 	if(it != NULL) {
 		memset(it, 0, sizeof(*it));
@@ -1700,12 +5306,10 @@ int btree_find_end(
 	
 	/* number of elements (i.e. resulting index + 1) can be retrieved
 	 * from root node alone */
-	index += node->fill;
-	for(i = 0; i <= node->fill; i++)
-		index += node->links[i].count;
+	index = subtree_size(self, node);
 	
 	if(it != NULL) {
-		while(node->links[node->fill].child != NULL)
+		while(!isleaf(node))
 			node = node->links[node->fill].child;
 		it->index = index;
 		it->node = node;
@@ -1720,8 +5324,8 @@ int btree_find_end(
 		btree_it_t *it)
 {
 	btree_node_t *node;
-	int pos;
-	int index;
+	btree_index_t pos;
+	btree_index_t index;
 
 	if(self->options & OPT_NOCMP)
 		return -EINVAL;
@@ -1734,7 +5338,7 @@ int btree_find_end(
 		it->index = index;
 		it->pos = pos;
 		it->node = node;
-		it->element = GET_E(self, node->elements + pos * self->element_size);
+		it->element = GET_E(self, node_element(self, node, pos));
 	}
 	return index;
 }
@@ -1747,8 +5351,8 @@ int btree_find_last(
 	if(self->options & OPT_NOCMP)
 		return -EINVAL;
 	btree_node_t *node;
-	int pos;
-	int index;
+	btree_index_t pos;
+	btree_index_t index;
 
 	if(self->options & OPT_NOCMP)
 		return -EINVAL;
@@ -1762,25 +5366,28 @@ int btree_find_last(
 		it->index = index;
 		it->pos = pos;
 		it->node = node;
-		it->element = GET_E(self, node->elements + pos * self->element_size);
+		it->element = GET_E(self, node_element(self, node, pos));
 	}
 	return index;
 }*/
 
-int btree_find_lower(
+btree_index_t btree_find_lower(
 		btree_t *self,
 		const void *key,
 		btree_it_t *it)
 {
 	btree_node_t *node;
-	int pos;
-	int index;
+	btree_index_t pos;
+	btree_index_t index;
 	bool found;
+	int ret;
 
 	if(self->options & OPT_NOCMP)
 		return -EINVAL;
 
 	found = find_lower(self, key, &node, &pos, self->group_default, self->hook_cmp);
+	if(it != NULL && (ret = leaf_open(self, node)) != 0)
+		return ret;
 	index = to_index(node, pos);
 	if(it != NULL) {
 		memset(it, 0, sizeof(*it));
@@ -1790,27 +5397,30 @@ int btree_find_lower(
 		if(node == NULL || pos == node->fill)
 			it->element = NULL;
 		else
-			it->element = GET_E(self, node->elements + pos * self->element_size);
+			it->element = GET_E(self, node_element(self, node, pos));
 		it->index = index;
 		it->found = found;
 	}
 	return index;
 }
 
-int btree_find_upper(
+btree_index_t btree_find_upper(
 		btree_t *self,
 		const void *key,
 		btree_it_t *it)
 {
 	btree_node_t *node;
-	int pos;
-	int index;
+	btree_index_t pos;
+	btree_index_t index;
 	bool found;
+	int ret;
 
 	if(self->options & OPT_NOCMP)
 		return -EINVAL;
 
 	found = find_upper(self, key, &node, &pos, self->group_default, self->hook_cmp);
+	if(it != NULL && (ret = leaf_open(self, node)) != 0)
+		return ret;
 	index = to_index(node, pos);
 	if(it != NULL) {
 		memset(it, 0, sizeof(*it));
@@ -1821,7 +5431,7 @@ int btree_find_upper(
 			it->element = NULL;
 		else {
 			assert(index < btree_size(self));
-			it->element = GET_E(self, node->elements + pos * self->element_size);
+			it->element = GET_E(self, node_element(self, node, pos));
 		}
 		it->index = index;
 		it->found = found;
@@ -1829,21 +5439,24 @@ int btree_find_upper(
 	return index;
 }
 
-int btree_find_lower_cmp(
+btree_index_t btree_find_lower_cmp(
 		btree_t *self,
 		btree_cmp_t cmp,
 		const void *key,
 		btree_it_t *it)
 {
 	btree_node_t *node;
-	int pos;
-	int index;
+	btree_index_t pos;
+	btree_index_t index;
 	bool found;
+	int ret;
 
 	if(self->options & OPT_NOCMP)
 		return -EINVAL;
 
 	found = find_lower(self, key, &node, &pos, self->group_default, cmp);
+	if(it != NULL && (ret = leaf_open(self, node)) != 0)
+		return ret;
 	index = to_index(node, pos);
 	if(it != NULL) {
 		memset(it, 0, sizeof(*it));
@@ -1853,28 +5466,31 @@ int btree_find_lower_cmp(
 		if(node == NULL || pos == node->fill)
 			it->element = NULL;
 		else
-			it->element = GET_E(self, node->elements + pos * self->element_size);
+			it->element = GET_E(self, node_element(self, node, pos));
 		it->index = index;
 		it->found = found;
 	}
 	return index;
 }
 
-int btree_find_upper_cmp(
+btree_index_t btree_find_upper_cmp(
 		btree_t *self,
 		btree_cmp_t cmp,
 		const void *key,
 		btree_it_t *it)
 {
 	btree_node_t *node;
-	int pos;
-	int index;
+	btree_index_t pos;
+	btree_index_t index;
 	bool found;
+	int ret;
 
 	if(self->options & OPT_NOCMP)
 		return -EINVAL;
 
 	found = find_upper(self, key, &node, &pos, self->group_default, cmp);
+	if(it != NULL && (ret = leaf_open(self, node)) != 0)
+		return ret;
 	index = to_index(node, pos);
 	if(it != NULL) {
 		memset(it, 0, sizeof(*it));
@@ -1885,7 +5501,7 @@ int btree_find_upper_cmp(
 			it->element = NULL;
 		else {
 			assert(index < btree_size(self));
-			it->element = GET_E(self, node->elements + pos * self->element_size);
+			it->element = GET_E(self, node_element(self, node, pos));
 		}
 		it->index = index;
 		it->found = found;
@@ -1893,21 +5509,24 @@ int btree_find_upper_cmp(
 	return index;
 }
 
-int btree_find_lower_group(
+btree_index_t btree_find_lower_group(
 		btree_t *self,
 		const void *key,
 		void *group,
 		btree_it_t *it)
 {
 	btree_node_t *node;
-	int pos;
-	int index;
+	btree_index_t pos;
+	btree_index_t index;
 	bool found;
+	int ret;
 
 	if(self->options & OPT_NOCMP)
 		return -EINVAL;
 
 	found = find_lower(self, key, &node, &pos, group, self->hook_cmp);
+	if(it != NULL && (ret = leaf_open(self, node)) != 0)
+		return ret;
 	index = to_index(node, pos);
 	if(it != NULL) {
 		memset(it, 0, sizeof(*it));
@@ -1917,28 +5536,31 @@ int btree_find_lower_group(
 		if(node == NULL)
 			it->element = NULL;
 		else
-			it->element = GET_E(self, node->elements + pos * self->element_size);
+			it->element = GET_E(self, node_element(self, node, pos));
 		it->index = index;
 		it->found = found;
 	}
 	return index;
 }
 
-int btree_find_upper_group(
+btree_index_t btree_find_upper_group(
 		btree_t *self,
 		const void *key,
 		void *group,
 		btree_it_t *it)
 {
 	btree_node_t *node;
-	int pos;
-	int index;
+	btree_index_t pos;
+	btree_index_t index;
 	bool found;
+	int ret;
 
 	if(self->options & OPT_NOCMP)
 		return -EINVAL;
 
 	found = find_upper(self, key, &node, &pos, group, self->hook_cmp); //TODO does find_upper return value make sense? reason: find_upper never returns a match. it is unclear, whether find_upper necessarily encounters an existing entry if it exists.
+	if(it != NULL && (ret = leaf_open(self, node)) != 0)
+		return ret;
 	index = to_index(node, pos);
 	if(it != NULL) {
 		memset(it, 0, sizeof(*it));
@@ -1949,7 +5571,7 @@ int btree_find_upper_group(
 			it->element = NULL;
 		else {
 			assert(index < btree_size(self));
-			it->element = GET_E(self, node->elements + pos * self->element_size);
+			it->element = GET_E(self, node_element(self, node, pos));
 		}
 		it->index = index;
 		it->found = found;
@@ -1957,7 +5579,7 @@ int btree_find_upper_group(
 	return index;
 }
 
-int btree_find_lower_group_cmp(
+btree_index_t btree_find_lower_group_cmp(
 		btree_t *self,
 		btree_cmp_t cmp,
 		const void *key,
@@ -1965,14 +5587,17 @@ int btree_find_lower_group_cmp(
 		btree_it_t *it)
 {
 	btree_node_t *node;
-	int pos;
-	int index;
+	btree_index_t pos;
+	btree_index_t index;
 	bool found;
+	int ret;
 
 	if(self->options & OPT_NOCMP)
 		return -EINVAL;
 
 	found = find_lower(self, key, &node, &pos, group, cmp);
+	if(it != NULL && (ret = leaf_open(self, node)) != 0)
+		return ret;
 	index = to_index(node, pos);
 	if(it != NULL) {
 		memset(it, 0, sizeof(*it));
@@ -1982,14 +5607,14 @@ int btree_find_lower_group_cmp(
 		if(node == NULL)
 			it->element = NULL;
 		else
-			it->element = GET_E(self, node->elements + pos * self->element_size);
+			it->element = GET_E(self, node_element(self, node, pos));
 		it->index = index;
 		it->found = found;
 	}
 	return index;
 }
 
-int btree_find_upper_group_cmp(
+btree_index_t btree_find_upper_group_cmp(
 		btree_t *self,
 		btree_cmp_t cmp,
 		const void *key,
@@ -1997,14 +5622,17 @@ int btree_find_upper_group_cmp(
 		btree_it_t *it)
 {
 	btree_node_t *node;
-	int pos;
-	int index;
+	btree_index_t pos;
+	btree_index_t index;
 	bool found;
+	int ret;
 
 	if(self->options & OPT_NOCMP)
 		return -EINVAL;
 
 	found = find_upper(self, key, &node, &pos, group, cmp); //TODO does find_upper return value make sense? reason: find_upper never returns a match. it is unclear, whether find_upper necessarily encounters an existing entry if it exists.
+	if(it != NULL && (ret = leaf_open(self, node)) != 0)
+		return ret;
 	index = to_index(node, pos);
 	if(it != NULL) {
 		memset(it, 0, sizeof(*it));
@@ -2015,7 +5643,7 @@ int btree_find_upper_group_cmp(
 			it->element = NULL;
 		else {
 			assert(index < btree_size(self));
-			it->element = GET_E(self, node->elements + pos * self->element_size);
+			it->element = GET_E(self, node_element(self, node, pos));
 		}
 		it->index = index;
 		it->found = found;
@@ -2023,23 +5651,26 @@ int btree_find_upper_group_cmp(
 	return index;
 }
 
-int btree_find_lower_group_in(
+btree_index_t btree_find_lower_group_in(
 		btree_t *self,
-		int l,
-		int u,
+		btree_index_t l,
+		btree_index_t u,
 		const void *key,
 		void *group,
 		btree_it_t *it)
 {
 	btree_node_t *node;
-	int pos;
+	btree_index_t pos;
 	bool found;
-	int index;
-	int size = btree_size(self);
+	btree_index_t index;
+	int ret;
+	btree_index_t size = btree_size(self);
 
 	if(u < l || u > size || l > size)
 		return -EINVAL;
 	found = find_lower_in(self, l, u, key, &node, &pos, group, self->hook_cmp);
+	if(it != NULL && (ret = leaf_open(self, node)) != 0)
+		return ret;
 	index = to_index(node, pos);
 	if(it != NULL) {
 		memset(it, 0, sizeof(*it));
@@ -2049,30 +5680,33 @@ int btree_find_lower_group_in(
 		if(node == NULL)
 			it->element = NULL;
 		else
-			it->element = GET_E(self, node->elements + pos * self->element_size);
+			it->element = GET_E(self, node_element(self, node, pos));
 		it->index = index;
 		it->found = found;
 	}
 	return index;
 }
 
-int btree_find_upper_group_in(
+btree_index_t btree_find_upper_group_in(
 		btree_t *self,
-		int l,
-		int u,
+		btree_index_t l,
+		btree_index_t u,
 		const void *key,
 		void *group,
 		btree_it_t *it)
 {
 	btree_node_t *node;
-	int pos;
+	btree_index_t pos;
 	bool found;
-	int index;
-	int size = btree_size(self);
+	btree_index_t index;
+	int ret;
+	btree_index_t size = btree_size(self);
 
 	if(u < l || u > size || l > size)
 		return -EINVAL;
 	found = find_upper_in(self, l, u, key, &node, &pos, group, self->hook_cmp);
+	if(it != NULL && (ret = leaf_open(self, node)) != 0)
+		return ret;
 	index = to_index(node, pos);
 	if(it != NULL) {
 		memset(it, 0, sizeof(*it));
@@ -2083,7 +5717,7 @@ int btree_find_upper_group_in(
 			it->element = NULL;
 		else {
 			assert(index < btree_size(self));
-			it->element = GET_E(self, node->elements + pos * self->element_size);
+			it->element = GET_E(self, node_element(self, node, pos));
 		}
 		it->index = index;
 		it->found = found;
@@ -2091,24 +5725,27 @@ int btree_find_upper_group_in(
 	return index;
 }
 
-int btree_find_lower_group_in_cmp(
+btree_index_t btree_find_lower_group_in_cmp(
 		btree_t *self,
 		btree_cmp_t cmp,
-		int l,
-		int u,
+		btree_index_t l,
+		btree_index_t u,
 		const void *key,
 		void *group,
 		btree_it_t *it)
 {
 	btree_node_t *node;
-	int pos;
+	btree_index_t pos;
 	bool found;
-	int index;
-	int size = btree_size(self);
+	btree_index_t index;
+	int ret;
+	btree_index_t size = btree_size(self);
 
 	if(u < l || u > size || l > size)
 		return -EINVAL;
 	found = find_lower_in(self, l, u, key, &node, &pos, group, cmp);
+	if(it != NULL && (ret = leaf_open(self, node)) != 0)
+		return ret;
 	index = to_index(node, pos);
 	if(it != NULL) {
 		memset(it, 0, sizeof(*it));
@@ -2118,31 +5755,34 @@ int btree_find_lower_group_in_cmp(
 		if(node == NULL)
 			it->element = NULL;
 		else
-			it->element = GET_E(self, node->elements + pos * self->element_size);
+			it->element = GET_E(self, node_element(self, node, pos));
 		it->index = index;
 		it->found = found;
 	}
 	return index;
 }
 
-int btree_find_upper_group_in_cmp(
+btree_index_t btree_find_upper_group_in_cmp(
 		btree_t *self,
 		btree_cmp_t cmp,
-		int l,
-		int u,
+		btree_index_t l,
+		btree_index_t u,
 		const void *key,
 		void *group,
 		btree_it_t *it)
 {
 	btree_node_t *node;
-	int pos;
+	btree_index_t pos;
 	bool found;
-	int index;
-	int size = btree_size(self);
+	btree_index_t index;
+	int ret;
+	btree_index_t size = btree_size(self);
 
 	if(u < l || u > size || l > size)
 		return -EINVAL;
 	found = find_upper_in(self, l, u, key, &node, &pos, group, cmp);
+	if(it != NULL && (ret = leaf_open(self, node)) != 0)
+		return ret;
 	index = to_index(node, pos);
 	if(it != NULL) {
 		memset(it, 0, sizeof(*it));
@@ -2153,7 +5793,7 @@ int btree_find_upper_group_in_cmp(
 			it->element = NULL;
 		else {
 			assert(index < btree_size(self));
-			it->element = GET_E(self, node->elements + pos * self->element_size);
+			it->element = GET_E(self, node_element(self, node, pos));
 		}
 		it->index = index;
 		it->found = found;
@@ -2165,23 +5805,28 @@ int btree_find_upper_group_in_cmp(
 int btree_validate_modified(
 		btree_it_t *it)
 {
+	if(it->node != NULL && !isstatic(it->tree))
+		node_changed(it->tree, it->node);
 	return validate_at(it->tree, it->element, it->node, it->pos, true) ? 0 : -EINVAL;
 }
 
-int btree_iterate_next(
+btree_index_t btree_iterate_next(
 		btree_it_t *it)
 {
-	int pos = it->pos;
+	btree_index_t pos = it->pos;
 	btree_node_t *node = it->node;
+	int ret;
 
 	if(!to_next(&node, &pos))
 		return -ENOENT;
+	else if((ret = leaf_open(it->tree, node)) != 0)
+		return ret;
 
 	it->index++;
 	if(pos == node->fill)
 		it->element = NULL;
 	else
-		it->element = GET_E(it->tree, node->elements + pos * it->tree->element_size);
+		it->element = GET_E(it->tree, node_element(it->tree, node, pos));
 	it->pos = pos;
 	it->node = node;
 	it->found = it->element != NULL;
@@ -2189,22 +5834,70 @@ int btree_iterate_next(
 	return it->index;
 }
 
-int btree_iterate_prev(
+btree_index_t btree_iterate_prev(
 		btree_it_t *it)
 {
-	int pos = it->pos;
+	btree_index_t pos = it->pos;
 	btree_node_t *node = it->node;
+	int ret;
 
 	if(!to_prev(&node, &pos))
 		return -ENOENT;
+	else if((ret = leaf_open(it->tree, node)) != 0)
+		return ret;
 
-	it->element = GET_E(it->tree, node->elements + pos * it->tree->element_size);
+	it->element = GET_E(it->tree, node_element(it->tree, node, pos));
 	it->index--;
 	it->pos = pos;
 	it->node = node;
 	return it->index;
 }
 
+/* btree_seek_lower()/btree_seek_upper() */
+static btree_index_t seek(
+		btree_it_t *it,
+		const void *key,
+		bool upper)
+{
+	btree_t *tree = it->tree;
+	btree_node_t *node = it->node;
+	btree_index_t pos = it->pos;
+	btree_index_t index;
+	bool found;
+	int ret;
+
+	if(tree->options & OPT_NOCMP)
+		return -EINVAL;
+
+	found = seek_bound(tree, key, &node, &pos, tree->group_default, tree->hook_cmp, upper);
+	if((ret = leaf_open(tree, node)) != 0)
+		return ret;
+	index = to_index(node, pos);
+	it->pos = pos;
+	it->node = node;
+	if(node == NULL || pos == node->fill)
+		it->element = NULL;
+	else
+		it->element = GET_E(tree, node_element(tree, node, pos));
+	it->index = index;
+	it->found = found;
+	return index;
+}
+
+btree_index_t btree_seek_lower(
+		btree_it_t *it,
+		const void *key)
+{
+	return seek(it, key, false);
+}
+
+btree_index_t btree_seek_upper(
+		btree_it_t *it,
+		const void *key)
+{
+	return seek(it, key, true);
+}
+
 void btree_dump(
 		btree_t *self,
 		void (*print)(const void *element))
@@ -2220,12 +5913,14 @@ static void dump_node(
 {
 	int i;
 	int k;
+	if(leaf_open(tree, node) != 0)
+		return;
 	for(i = 0; i < node->fill;/*MIN(node->fill, tree->order - 1);*/ i++) {
 		printf("| ");
-		print(GET_E(tree, node->elements + i * tree->element_size));
+		print(GET_E(tree, node_element(tree, node, i)));
 		printf(" ");
 	}
-	for(i = node->fill; i < tree->order - 1; i++)
+	for(i = node->fill; i < node_order(tree, node) - 1; i++)
 		printf("| --- ");
 	if(tree->overflow_node == node) {
 		printf("# ");
@@ -2234,11 +5929,13 @@ static void dump_node(
 	}
 	else
 		printf("|\n");
+	if(isleaf(node))
+		return;
 	for(i = 0; i <= node->fill; i++) {
 		if(node->links[i].child != NULL && node->links[i].child->fill > 0) {
 			for(k = 0; k <= indent; k++)
 				printf("  ");
-			printf("[%3d %3d] ", node->links[i].offset, node->links[i].count);
+			printf("[%3lld %3lld] ", (long long)node->links[i].offset, (long long)node->links[i].count);
 			for(k = 0; k < i; k++)
 				printf("-");
 			printf("+");
@@ -2254,7 +5951,7 @@ static void dump_node(
 		else {
 			for(k = 0; k <= indent; k++)
 				printf("  ");
-			printf("[%3d %3d] ", node->links[i].offset, node->links[i].count);
+			printf("[%3lld %3lld] ", (long long)node->links[i].offset, (long long)node->links[i].count);
 			for(k = 0; k < i; k++)
 				printf("-");
 			printf("+");
@@ -2267,7 +5964,7 @@ static void dump_node(
 		if(tree->overflow_link.child != NULL && tree->overflow_link.child->fill > 0) {
 			for(k = 0; k <= indent; k++)
 				printf("  ");
-			printf("[%3d %3d] ", tree->overflow_link.offset, tree->overflow_link.count);
+			printf("[%3lld %3lld] ", (long long)tree->overflow_link.offset, (long long)tree->overflow_link.count);
 			for(k = 0; k < tree->order - 1; k++)
 				printf(" ");
 			printf("#");
@@ -0,0 +1,256 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "../include/memory.h"
+#include "pool.h"
+
+#define MAX(X, Y) ((X) > (Y) ? (X) : (Y))
+
+#define MAGAZINE 32 /* number of nodes exchanged between a thread cache and the depot at once */
+#define DEPOT_LIMIT_DEFAULT (16 * 1024 * 1024)
+
+/* header written into unused nodes. nodes within a magazine are linked through 'next',
+ * magazines within the depot through 'next_magazine' of their first node. */
+typedef struct pool_link pool_link_t;
+struct pool_link {
+	pool_link_t *next;
+	pool_link_t *next_magazine;
+	int count; /* number of nodes in magazine, only valid for first node */
+};
+
+struct pool_class {
+	size_t size; /* node size in bytes */
+	size_t align; /* node alignment in bytes */
+	int id; /* index into thread caches */
+	pool_class_t *next;
+	pool_link_t *depot; /* magazines available to all threads */
+};
+
+typedef struct {
+	pool_link_t *head;
+	int count;
+} pool_cache_t;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static pthread_key_t key; /* used to flush thread caches when a thread exits */
+static pool_class_t *classes;
+static int n_classes;
+static size_t depot_bytes;
+static size_t depot_limit = DEPOT_LIMIT_DEFAULT;
+
+static __thread pool_cache_t *caches;
+static __thread int n_caches;
+
+static void *new_node(
+		pool_class_t *cls)
+{
+	void *ptr;
+
+	if(cls->align <= sizeof(void*))
+		return malloc(cls->size);
+	else if(posix_memalign(&ptr, cls->align, cls->size) != 0)
+		return NULL;
+	else
+		return ptr;
+}
+
+static void free_magazine(
+		pool_link_t *head)
+{
+	pool_link_t *next;
+
+	while(head != NULL) {
+		next = head->next;
+		free(head);
+		head = next;
+	}
+}
+
+/* hand a magazine over to the depot. if the depot is full, the nodes are freed */
+static void depot_put(
+		pool_class_t *cls,
+		pool_link_t *head,
+		int count)
+{
+	head->count = count;
+	pthread_mutex_lock(&lock);
+	if(depot_bytes + count * cls->size <= depot_limit) {
+		head->next_magazine = cls->depot;
+		cls->depot = head;
+		depot_bytes += count * cls->size;
+		head = NULL;
+	}
+	pthread_mutex_unlock(&lock);
+	free_magazine(head);
+}
+
+static pool_link_t *depot_get(
+		pool_class_t *cls,
+		int *count)
+{
+	pool_link_t *head;
+
+	pthread_mutex_lock(&lock);
+	head = cls->depot;
+	if(head != NULL) {
+		cls->depot = head->next_magazine;
+		depot_bytes -= head->count * cls->size;
+		*count = head->count;
+	}
+	pthread_mutex_unlock(&lock);
+	return head;
+}
+
+static void flush_caches(
+		void *arg)
+{
+	pool_cache_t *cache = arg;
+	pool_class_t *cls;
+
+	pthread_mutex_lock(&lock);
+	cls = classes;
+	pthread_mutex_unlock(&lock);
+	for(; cls != NULL; cls = cls->next)
+		if(cls->id < n_caches && cache[cls->id].head != NULL)
+			depot_put(cls, cache[cls->id].head, cache[cls->id].count);
+	free(cache);
+	if(cache == caches) {
+		caches = NULL;
+		n_caches = 0;
+	}
+}
+
+static void init_key()
+{
+	pthread_key_create(&key, flush_caches);
+}
+
+static pool_cache_t *thread_cache(
+		pool_class_t *cls)
+{
+	pool_cache_t *resized;
+	int n;
+
+	if(cls->id >= n_caches) {
+		n = MAX(cls->id + 1, 2 * n_caches);
+		resized = realloc(caches, n * sizeof(pool_cache_t));
+		if(resized == NULL)
+			return NULL;
+		memset(resized + n_caches, 0, (n - n_caches) * sizeof(pool_cache_t));
+		caches = resized;
+		n_caches = n;
+		pthread_once(&once, init_key);
+		pthread_setspecific(key, caches);
+	}
+	return caches + cls->id;
+}
+
+pool_class_t *node_pool_class(
+		size_t size,
+		size_t align)
+{
+	pool_class_t *cls;
+
+	if(size < sizeof(pool_link_t))
+		size = sizeof(pool_link_t);
+	pthread_mutex_lock(&lock);
+	for(cls = classes; cls != NULL; cls = cls->next)
+		if(cls->size == size && cls->align == align)
+			break;
+	if(cls == NULL) {
+		cls = calloc(1, sizeof(pool_class_t));
+		if(cls != NULL) {
+			cls->size = size;
+			cls->align = align;
+			cls->id = n_classes++;
+			cls->next = classes;
+			classes = cls;
+		}
+	}
+	pthread_mutex_unlock(&lock);
+	return cls;
+}
+
+void *node_pool_alloc(
+		pool_class_t *cls)
+{
+	pool_cache_t *cache = thread_cache(cls);
+	pool_link_t *node;
+
+	if(cache == NULL)
+		return new_node(cls);
+	if(cache->head == NULL) {
+		cache->head = depot_get(cls, &cache->count);
+		if(cache->head == NULL)
+			return new_node(cls);
+	}
+	node = cache->head;
+	cache->head = node->next;
+	cache->count--;
+	return node;
+}
+
+void node_pool_free(
+		pool_class_t *cls,
+		void *ptr)
+{
+	pool_cache_t *cache = thread_cache(cls);
+	pool_link_t *node = ptr;
+	pool_link_t *head;
+	pool_link_t *last;
+	int i;
+
+	if(cache == NULL) {
+		free(ptr);
+		return;
+	}
+	if(cache->count == 2 * MAGAZINE) { /* cache is full, move one magazine to the depot */
+		head = cache->head;
+		last = head;
+		for(i = 1; i < MAGAZINE; i++)
+			last = last->next;
+		cache->head = last->next;
+		cache->count -= MAGAZINE;
+		last->next = NULL;
+		depot_put(cls, head, MAGAZINE);
+	}
+	node->next = cache->head;
+	cache->head = node;
+	cache->count++;
+}
+
+void btree_pool_set_limit(
+		size_t bytes)
+{
+	pthread_mutex_lock(&lock);
+	depot_limit = bytes;
+	pthread_mutex_unlock(&lock);
+}
+
+void btree_pool_trim()
+{
+	pool_class_t *cls;
+	pool_link_t *magazines = NULL;
+	pool_link_t *depot;
+	pool_link_t *next;
+
+	pthread_mutex_lock(&lock);
+	for(cls = classes; cls != NULL; cls = cls->next) {
+		for(depot = cls->depot; depot != NULL; depot = next) {
+			next = depot->next_magazine;
+			depot->next_magazine = magazines;
+			magazines = depot;
+		}
+		cls->depot = NULL;
+	}
+	depot_bytes = 0;
+	pthread_mutex_unlock(&lock);
+
+	for(; magazines != NULL; magazines = next) {
+		next = magazines->next_magazine;
+		free_magazine(magazines);
+	}
+}
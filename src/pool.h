@@ -0,0 +1,26 @@
+#ifndef _BTREE_POOL_H
+#define _BTREE_POOL_H
+
+#include <stddef.h>
+
+/* process-wide node pool shared by all trees using BTREE_OPT_SHARED_POOL.
+ * nodes are grouped by their byte size. each thread keeps a small cache per size,
+ * which exchanges whole magazines of nodes with a central depot. */
+
+typedef struct pool_class pool_class_t;
+
+/* returns the pool for nodes of 'size' bytes aligned to 'align' bytes, creating it if necessary.
+ * returns NULL if memory is exhausted. the returned pool is never freed. */
+pool_class_t *node_pool_class(
+		size_t size,
+		size_t align);
+
+/* returns uninitialized memory of the pool's size or NULL */
+void *node_pool_alloc(
+		pool_class_t *cls);
+
+void node_pool_free(
+		pool_class_t *cls,
+		void *ptr);
+
+#endif